@@ -1,6 +1,10 @@
 #pragma once
 // Minimal, array only refactor of stb_ds.h by Sean Barrett.
 // https://github.com/nothings/stb/blob/master/stb_ds.h
+// Arrays can also live in an xarena, a bump allocator over memory you own. Growing an arena
+// array bumps a new block and abandons the old one, nothing is freed until xarena_reset. An arena
+// array that no longer fits moves to the heap, and from then on is freed like any other.
+// A grow that gets no memory leaves the array as it was, and push, insert and setlen do nothing.
 #include <stddef.h>
 #include <string.h>
 #if !(defined(XARR_REALLOC) || defined(XARR_FREE))
@@ -8,37 +12,101 @@
 #define XARR_REALLOC(ptr, size) realloc(ptr, size)
 #define XARR_FREE(ptr) free(ptr)
 #endif
+#define XARENA_ALIGN 64
+struct xarena
+{
+    char *base;
+    size_t size; // bytes
+    size_t used; // bytes
+};
+static inline void xarena_init(struct xarena *arena, void *mem, size_t size)
+{
+    arena->base = (char *)mem;
+    arena->size = size;
+    arena->used = 0;
+}
+static inline void xarena_reset(struct xarena *arena) { arena->used = 0; }
+// Returns XARENA_ALIGN aligned memory (relative to base), or NULL when the arena is full
+static inline void *xarena_alloc(struct xarena *arena, size_t size)
+{
+    size_t start = (arena->used + XARENA_ALIGN - 1) & ~(size_t)(XARENA_ALIGN - 1);
+    if (start > arena->size || size > arena->size - start)
+        return NULL;
+    arena->used = start + size;
+    return arena->base + start;
+}
 struct xarray_header
 {
-    size_t length;   // current num elements
-    size_t capacity; // max num elements
+    size_t length;        // current num elements
+    size_t capacity;      // max num elements
+    struct xarena *arena; // NULL when the array is on the heap
+    size_t pad;           // keeps elements 16 byte aligned
 };
+static inline void *__xarr_realloc(void *a, size_t elem_size, size_t next_cap)
+{
+    struct xarray_header *h = a ? (struct xarray_header *)a - 1 : NULL;
+    size_t size = elem_size * next_cap + sizeof(struct xarray_header);
+    if (!h || !h->arena)
+        return XARR_REALLOC(h, size);
+    struct xarray_header *next = (struct xarray_header *)xarena_alloc(h->arena, size);
+    const int to_heap = !next;
+    if (to_heap && !(next = (struct xarray_header *)XARR_REALLOC(NULL, size)))
+        return NULL;
+    memcpy(next, h, sizeof(struct xarray_header) + elem_size * h->length);
+    if (to_heap)
+        next->arena = NULL;
+    return next;
+}
 // clang-format off
 #define xarr_header(a)        ((struct xarray_header*)(a)-1)
 #define xarr_len(a)           ((a) ? xarr_header(a)->length : 0)
 #define xarr_cap(a)           ((a) ? xarr_header(a)->capacity : 0)
-#define xarr_free(a)          ((void)((a) ? XARR_FREE(xarr_header(a)) : (void)0), (a) = NULL)
+#define xarr_free(a)          ((void)((a) && !xarr_header(a)->arena ? XARR_FREE(xarr_header(a)) : (void)0), (a) = NULL)
 #ifdef __cplusplus
 #define xarr_T T
 template<class xarr_T>
 #else
 #define xarr_T void
 #endif
-static xarr_T* __xarr_setcap(struct xarray_header* next_ptr, size_t next_cap, xarr_T* ptr) {
-    if (!ptr) next_ptr->length = 0;
+static inline xarr_T* __xarr_setcap(void* next, size_t next_cap, xarr_T* ptr) {
+    struct xarray_header* next_ptr = (struct xarray_header*)next;
+    if (!next_ptr) return ptr; // out of memory, the old array is still whole
+    if (!ptr) next_ptr->length = 0, next_ptr->arena = NULL;
     next_ptr->capacity = next_cap;
     return (xarr_T*)(next_ptr+1);
 }
+#ifdef __cplusplus
+template<class xarr_T>
+#endif
+static inline xarr_T* __xarr_arena_init(struct xarena* arena, size_t elem_size, size_t cap, xarr_T* ptr) {
+    struct xarray_header* h = (struct xarray_header*)xarena_alloc(arena, elem_size*cap+sizeof(struct xarray_header));
+    (void)ptr; // only there to give the template its type
+    if (!h) return (xarr_T*)NULL; // an empty heap array, which grows on the heap
+    h->length = 0;
+    h->capacity = cap;
+    h->arena = arena;
+    return (xarr_T*)(h+1);
+}
+// Grows geometrically, so repeated pushes are amortised O(1)
 #define xarr_setcap(a, N)     (xarr_cap(a) < (N) \
-                              ? (void)((a) = __xarr_setcap((struct xarray_header*)XARR_REALLOC(((a) ? (void*)xarr_header(a) : (void*)a), sizeof(*a)*(N<(xarr_cap(a)*2)?(xarr_cap(a)*2):N)+sizeof(struct xarray_header)), (N<(xarr_cap(a)*2)?(xarr_cap(a)*2):N), (a)))\
+                              ? (void)((a) = __xarr_setcap(__xarr_realloc((a), sizeof(*a), (N<(xarr_cap(a)*2)?(xarr_cap(a)*2):N)), (N<(xarr_cap(a)*2)?(xarr_cap(a)*2):N), (a)))\
                               : (void)0)
-#define xarr_setlen(a, N)     (xarr_len(a) != (N) ? (void)(xarr_setcap((a), (N)), xarr_header(a)->length = (N)) : (void)0)
+// Grows to exactly N, for when the final size is known up front
+#define xarr_reserve(a, N)    (xarr_cap(a) < (N) ? (void)((a) = __xarr_setcap(__xarr_realloc((a), sizeof(*a), (N)), (N), (a))) : (void)0)
+// Starts an empty array with capacity N inside the arena, or on the heap when the arena is full.
+// a must not already own memory.
+#define xarr_arena_init(a, arena, N) ((a) = __xarr_arena_init((arena), sizeof(*a), (N), (a)))
+// Nonzero when a has room for N elements, after growing it if needed
+#define __xarr_grew(a, N)     (xarr_setcap((a), (N)), xarr_cap(a) >= (N))
+#define xarr_setlen(a, N)     (xarr_len(a) != (N) && __xarr_grew((a), (N)) ? (void)(xarr_header(a)->length = (N)) : (void)0)
 #define xarr_addn(a, N)       (xarr_setlen(a, xarr_len(a) + (N)))
-#define xarr_push(a, v)       (xarr_setcap(a, xarr_len(a) + 1), (a)[xarr_header(a)->length++] = (v))
-#define xarr_insertn(a, i, N) (xarr_addn((a), (N)), memmove(&(a)[(i) + (N)],  &(a)[i], sizeof *(a) * (xarr_header(a)->length - (N) - (i))))
-#define xarr_insert(a, i, v)  (xarr_insertn((a), (i), 1), (a)[i] = (v))
+#define xarr_push(a, v)       (__xarr_grew((a), xarr_len(a) + 1) ? (void)((a)[xarr_header(a)->length++] = (v)) : (void)0)
+#define xarr_insertn(a, i, N) (__xarr_grew((a), xarr_len(a) + (N)) ? (void)(xarr_header(a)->length += (N), memmove(&(a)[(i) + (N)],  &(a)[i], sizeof *(a) * (xarr_header(a)->length - (N) - (i)))) : (void)0)
+#define xarr_insert(a, i, v)  (__xarr_grew((a), xarr_len(a) + 1) ? (void)(xarr_insertn((a), (i), 1), (a)[i] = (v)) : (void)0)
 #define xarr_deleten(a, i, N) (memmove(&(a)[i], &(a)[(i) + (N)], sizeof *(a) * (xarr_header(a)->length - (N) - (i))), xarr_header(a)->length -= (N))
 #define xarr_delete(a, i)     xarr_deleten(a, (i), 1)
+// O(1) delete that moves the last element into the hole, so order is not kept
+#define xarr_swap_remove(a, i) ((a)[i] = xarr_last(a), xarr_header(a)->length--)
 #define xarr_last(a)          ((a)[xarr_header(a)->length - 1])
 #define xarr_pop(a)           (xarr_header(a)->length--, (a)[xarr_header(a)->length])
 #define xarr_end(a)          ((a) + xarr_len(a))
@@ -4,6 +4,8 @@
 // https://github.com/free-audio/clap-helpers/blob/main/include/clap/helpers/plugin.hh
 
 #include "common.h"
+#include "shapers.h"
+#include "display.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -11,12 +13,15 @@
 
 #include <math.h>
 #include <assert.h>
-#include <nanovg_compat.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+#ifndef NDEBUG
+C99DIST_THREAD_LOCAL int c99dist_in_process = 0; // see C99DIST_PROCESS_BEGIN
+#endif
+
 static const clap_plugin_descriptor_t s_c99dist_desc = {
     .clap_version = CLAP_VERSION_INIT,
     .id = "org.surge-synth-team.clap-c99-distortion",
@@ -31,26 +36,156 @@ static const clap_plugin_descriptor_t s_c99dist_desc = {
         (const char *[]){CLAP_PLUGIN_FEATURE_AUDIO_EFFECT, CLAP_PLUGIN_FEATURE_STEREO, NULL},
 };
 
-enum ClipType
-{
-    HARD = 0,
-    SOFT = 1,
-    FOLD = 2
-};
+// Variants are the same plugin locked to one shaper and channel count. Each gets its own process
+// function with both baked in, so there is no mode dispatch left in the audio path.
+// X(ID, id suffix, name, mode, channels)
+// The ids end up in sessions, never change or reuse one. Append new variants at the end.
+// clang-format off
+#define C99DIST_VARIANTS(X)                                                                        \
+    X(HARD_MONO,   "hard-clip-mono",   "C99 Hard Clip Mono",   HARD, 1)                            \
+    X(HARD_STEREO, "hard-clip-stereo", "C99 Hard Clip Stereo", HARD, 2)                            \
+    X(SOFT_STEREO, "soft-clip-stereo", "C99 Soft Clip Stereo", SOFT, 2)                            \
+    X(FOLD_MONO,   "folder-mono",      "C99 Folder Mono",      FOLD, 1)                            \
+    X(FOLD_STEREO, "folder-stereo",    "C99 Folder Stereo",    FOLD, 2)                            \
+    X(TUBE_STEREO, "tube-stereo",      "C99 Tube Stereo",      TUBE, 2)
+// clang-format on
+
+#define C99DIST_FEATURE_1 CLAP_PLUGIN_FEATURE_MONO
+#define C99DIST_FEATURE_2 CLAP_PLUGIN_FEATURE_STEREO
+
+#define C99DIST_VARIANT_DESC(ID, suffix, vname, mode, nch)                                         \
+    static const clap_plugin_descriptor_t s_c99dist_desc_##ID = {                                  \
+        .clap_version = CLAP_VERSION_INIT,                                                         \
+        .id = "org.surge-synth-team.clap-c99-distortion." suffix,                                  \
+        .name = vname,                                                                             \
+        .vendor = "Surge Synth Team",                                                              \
+        .url = "https://surge-synth-team.org/",                                                    \
+        .manual_url = "",                                                                          \
+        .support_url = "",                                                                         \
+        .version = "1.0.0",                                                                        \
+        .description = "The C99 distortion with a single fixed waveshaper",                        \
+        .features = (const char *[]){CLAP_PLUGIN_FEATURE_AUDIO_EFFECT, C99DIST_FEATURE_##nch,      \
+                                     NULL},                                                        \
+    };
+C99DIST_VARIANTS(C99DIST_VARIANT_DESC)
 
 enum ParamIds
 {
     pid_DRIVE = 2112,
     pid_MIX = 8675309,
-    pid_MODE = 5150
+    pid_MODE = 5150,
+    pid_LOW_CUT = 1812,
+    pid_EMPHASIS = 1984,
+    pid_HIGH_CUT = 2001,
+    pid_DC_BLOCK = 1066,
+    pid_OUTPUT = 1215,
+    pid_AUTO_GAIN = 1969,
+    pid_BANDS = 4000,
+    pid_CROSSOVER = 4001,  // + crossover index
+    pid_BAND_MODE = 4100,  // + band index
+    pid_BAND_DRIVE = 4200, // + band index
+    pid_BAND_MIX = 4300,   // + band index
+    pid_LOOKAHEAD = 4400,
+    pid_SIDECHAIN = 4500
 };
 
-static void c99dist_process_event(clap_c99_distortion_plug *plug, const clap_event_header_t *hdr);
+// The low and high cut are off at the ends of their ranges
+#define LOW_CUT_MIN 20.f
+#define LOW_CUT_MAX 2000.f
+#define HIGH_CUT_MIN 1000.f
+#define HIGH_CUT_MAX 20000.f
+#define EMPHASIS_RANGE 12.f
+#define EMPHASIS_FREQ 1000.0
+#define DC_BLOCK_FREQ 10.0
+#define OUTPUT_MIN -24.f
+#define OUTPUT_MAX 12.f
+#define SIDECHAIN_RANGE 7.f
+
+static const float s_crossover_min[MAX_CROSSOVERS] = {40.f, 200.f, 1000.f};
+static const float s_crossover_max[MAX_CROSSOVERS] = {1000.f, 5000.f, 16000.f};
+static const float s_crossover_default[MAX_CROSSOVERS] = {150.f, 1000.f, 5000.f};
+
+// The first parameter index of the per band block, three per band: mode, drive, mix
+#define BAND_PARAM_INDEX 13
+#define LOOKAHEAD_PARAM_INDEX (BAND_PARAM_INDEX + 3 * MAX_BANDS)
+#define SIDECHAIN_PARAM_INDEX (LOOKAHEAD_PARAM_INDEX + 1)
+
+static void c99dist_process_event(clap_c99_distortion_plug *plug, const clap_event_header_t *hdr,
+                                  const clap_output_events_t *out);
+static void c99dist_params_swap(clap_c99_distortion_plug *plug);
+static void c99dist_params_current(const clap_c99_distortion_plug *plug, c99dist_params_state *out);
+
+static int32_t c99dist_clamp_mode(int32_t mode)
+{
+    return mode < 0 ? 0 : mode >= CLIP_TYPE_COUNT ? CLIP_TYPE_COUNT - 1 : mode;
+}
+
+// What a mode parameter ends up as. Fixed variants ignore the value and keep their own mode.
+static int32_t c99dist_lock_mode(const clap_c99_distortion_plug *plug, int32_t mode)
+{
+    return plug->variant->mode < 0 ? c99dist_clamp_mode(mode) : plug->variant->mode;
+}
+
+// 1 + drive, with drive clamped to the range of the shaper
+static float c99dist_drive_gain(int32_t mode, float drive)
+{
+    const c99dist_shaper *shaper = &s_shapers[mode];
+    drive = drive < shaper->drive_min ? shaper->drive_min : drive;
+    drive = drive > shaper->drive_max ? shaper->drive_max : drive;
+    return 1.f + drive;
+}
+
+static int32_t c99dist_clamp_bands(int32_t bands)
+{
+    return bands < 1 ? 1 : bands > MAX_BANDS ? MAX_BANDS : bands;
+}
+
+// Where a parameter sits in c99dist_params_state, -1 for ids the plugin doesn't have
+static int c99dist_state_index(clap_id param_id)
+{
+    switch (param_id)
+    {
+    case pid_DRIVE:
+        return sidx_DRIVE;
+    case pid_MIX:
+        return sidx_MIX;
+    case pid_MODE:
+        return sidx_MODE;
+    case pid_LOW_CUT:
+        return sidx_LOW_CUT;
+    case pid_EMPHASIS:
+        return sidx_EMPHASIS;
+    case pid_HIGH_CUT:
+        return sidx_HIGH_CUT;
+    case pid_DC_BLOCK:
+        return sidx_DC_BLOCK;
+    case pid_OUTPUT:
+        return sidx_OUTPUT;
+    case pid_AUTO_GAIN:
+        return sidx_AUTO_GAIN;
+    case pid_LOOKAHEAD:
+        return sidx_LOOKAHEAD;
+    case pid_SIDECHAIN:
+        return sidx_SIDECHAIN;
+    case pid_BANDS:
+        return sidx_BANDS;
+    }
+    if (param_id >= pid_CROSSOVER && param_id < pid_CROSSOVER + MAX_CROSSOVERS)
+        return sidx_BANDS + 1 + (param_id - pid_CROSSOVER);
+    if (param_id >= pid_BAND_MODE && param_id < pid_BAND_MODE + MAX_BANDS)
+        return sidx_BANDS + 1 + MAX_CROSSOVERS + 3 * (param_id - pid_BAND_MODE);
+    if (param_id >= pid_BAND_DRIVE && param_id < pid_BAND_DRIVE + MAX_BANDS)
+        return sidx_BANDS + 1 + MAX_CROSSOVERS + 3 * (param_id - pid_BAND_DRIVE) + 1;
+    if (param_id >= pid_BAND_MIX && param_id < pid_BAND_MIX + MAX_BANDS)
+        return sidx_BANDS + 1 + MAX_CROSSOVERS + 3 * (param_id - pid_BAND_MIX) + 2;
+    return -1;
+}
 
 /////////////////////
 // clap_plugin_gui //
 /////////////////////
 
+#if C99DIST_GUI
 void init_NanoVG(clap_c99_distortion_plug *plug)
 {
     plug->gui->pixel_scale = get_pixel_scale(plug->gui->window);
@@ -96,8 +231,6 @@ void GUIDraw(clap_c99_distortion_plug *plug)
 #define GUI_API CLAP_WINDOW_API_WIN32
 #elif defined(__APPLE__)
 #define GUI_API CLAP_WINDOW_API_COCOA
-#else
-#error "TODO: support linux"
 #endif
 
 static bool c99dist_gui_is_api_supported(const clap_plugin_t *plugin, const char *api,
@@ -121,7 +254,7 @@ static bool c99dist_gui_create(const clap_plugin_t *_plugin, const char *api, bo
 
     clap_c99_distortion_plug *plug = _plugin->plugin_data;
 
-    clap_c99_gui *gui = calloc(1, sizeof(clap_c99_gui));
+    clap_c99_gui *gui = c99dist_calloc(1, sizeof(clap_c99_gui));
     plug->gui = gui;
     gui->plug = plug;
 
@@ -155,7 +288,7 @@ static void c99dist_gui_destroy(const clap_plugin_t *_plugin)
     if (plug->gui->nvg)
         nvgDeleteContext(plug->gui->nvg);
     GUIDestroy(plug);
-    free(plug->gui);
+    c99dist_free(plug->gui);
     plug->gui = NULL;
 }
 static bool c99dist_gui_set_scale(const clap_plugin_t *plugin, double scale) { return false; }
@@ -233,6 +366,7 @@ static const clap_plugin_gui_t s_c99dist_gui = {
     .show = c99dist_gui_show,
     .hide = c99dist_gui_hide,
 };
+#endif
 
 ///////////////////////////////
 // clap_plugin_timer_support //
@@ -240,11 +374,13 @@ static const clap_plugin_gui_t s_c99dist_gui = {
 
 static void c99dist_timer_support_on_timer(const clap_plugin_t *_plugin, clap_id timerID)
 {
+#if C99DIST_GUI
     clap_c99_distortion_plug *plug = _plugin->plugin_data;
 
     // If the GUI is open and at least one parameter value has changed...
     if (plug->gui && timerID == plug->gui->draw_timer_ID)
         GUIDraw(plug);
+#endif
 }
 
 static const clap_plugin_timer_support_t s_c99dist_timer_support = {
@@ -255,21 +391,29 @@ static const clap_plugin_timer_support_t s_c99dist_timer_support = {
 // clap_plugin_audio_ports //
 /////////////////////////////
 
-static uint32_t c99dist_audio_ports_count(const clap_plugin_t *plugin, bool is_input) { return 1; }
+// The second input is the sidechain
+static uint32_t c99dist_audio_ports_count(const clap_plugin_t *plugin, bool is_input)
+{
+    return is_input ? 2 : 1;
+}
 
 static bool c99dist_audio_ports_get(const clap_plugin_t *plugin, uint32_t index, bool is_input,
                                     clap_audio_port_info_t *info)
 {
-    if (index > 0)
+    if (index >= c99dist_audio_ports_count(plugin, is_input))
         return false;
-    info->id = 0;
-    if (is_input)
-        snprintf(info->name, sizeof(info->name), "%s", "Stereo In");
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+    const bool mono = plug->variant->channels == 1;
+    info->id = index;
+    if (index == 1)
+        snprintf(info->name, sizeof(info->name), "%s", "Sidechain");
+    else if (is_input)
+        snprintf(info->name, sizeof(info->name), "%s", mono ? "Mono In" : "Stereo In");
     else
         snprintf(info->name, sizeof(info->name), "%s", "Distorted Output");
-    info->channel_count = 2;
-    info->flags = CLAP_AUDIO_PORT_IS_MAIN;
-    info->port_type = CLAP_PORT_STEREO;
+    info->channel_count = plug->variant->channels;
+    info->flags = index == 0 ? CLAP_AUDIO_PORT_IS_MAIN : 0;
+    info->port_type = mono ? CLAP_PORT_MONO : CLAP_PORT_STEREO;
     info->in_place_pair = CLAP_INVALID_ID;
     return true;
 }
@@ -283,7 +427,11 @@ static const clap_plugin_audio_ports_t s_c99dist_audio_ports = {
 // clap_latency //
 //////////////////
 
-uint32_t c99dist_latency_get(const clap_plugin_t *plugin) { return 0; }
+uint32_t c99dist_latency_get(const clap_plugin_t *plugin)
+{
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+    return plug->dsp.lookahead_active ? plug->dsp.la.length : 0;
+}
 
 static const clap_plugin_latency_t s_c99dist_latency = {
     .get = c99dist_latency_get,
@@ -293,7 +441,10 @@ static const clap_plugin_latency_t s_c99dist_latency = {
 // clap_params //
 /////////////////
 
-uint32_t c99dist_param_count(const clap_plugin_t *plugin) { return 3; }
+uint32_t c99dist_param_count(const clap_plugin_t *plugin)
+{
+    return SIDECHAIN_PARAM_INDEX + 1;
+}
 bool c99dist_param_get_info(const clap_plugin_t *plugin, uint32_t param_index,
                             clap_param_info_t *param_info)
 {
@@ -304,9 +455,19 @@ bool c99dist_param_get_info(const clap_plugin_t *plugin, uint32_t param_index,
         strncpy(param_info->name, "Drive", CLAP_NAME_SIZE);
         param_info->module[0] = 0;
         param_info->default_value = 0.;
-        param_info->min_value = -1;
-        param_info->max_value = 6;
-        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        // The widest range any shaper responds to, each mode clamps to its own range
+        param_info->min_value = s_shapers[0].drive_min;
+        param_info->max_value = s_shapers[0].drive_max;
+        for (int i = 1; i < CLIP_TYPE_COUNT; i++)
+        {
+            if (s_shapers[i].drive_min < param_info->min_value)
+                param_info->min_value = s_shapers[i].drive_min;
+            if (s_shapers[i].drive_max > param_info->max_value)
+                param_info->max_value = s_shapers[i].drive_max;
+        }
+        // Modulation offsets the drive of the whole bus. The plugin only hears the mix, so there
+        // are no voices and nothing to modulate per note.
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE;
         param_info->cookie = NULL;
         break;
     case 1: // mix
@@ -325,89 +486,363 @@ bool c99dist_param_get_info(const clap_plugin_t *plugin, uint32_t param_index,
         param_info->module[0] = 0;
         param_info->default_value = 0.;
         param_info->min_value = 0;
-        param_info->max_value = 2;
+        param_info->max_value = CLIP_TYPE_COUNT - 1;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
+        param_info->cookie = NULL;
+        break;
+    case 3: // low cut
+        param_info->id = pid_LOW_CUT;
+        strncpy(param_info->name, "Low Cut", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = LOW_CUT_MIN;
+        param_info->min_value = LOW_CUT_MIN;
+        param_info->max_value = LOW_CUT_MAX;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        param_info->cookie = NULL;
+        break;
+    case 4: // emphasis
+        param_info->id = pid_EMPHASIS;
+        strncpy(param_info->name, "Emphasis", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = 0.;
+        param_info->min_value = -EMPHASIS_RANGE;
+        param_info->max_value = EMPHASIS_RANGE;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        param_info->cookie = NULL;
+        break;
+    case 5: // high cut
+        param_info->id = pid_HIGH_CUT;
+        strncpy(param_info->name, "High Cut", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = HIGH_CUT_MAX;
+        param_info->min_value = HIGH_CUT_MIN;
+        param_info->max_value = HIGH_CUT_MAX;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        param_info->cookie = NULL;
+        break;
+    case 6: // dc block
+        param_info->id = pid_DC_BLOCK;
+        strncpy(param_info->name, "DC Block", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = 1.;
+        param_info->min_value = 0;
+        param_info->max_value = 1;
         param_info->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
         param_info->cookie = NULL;
         break;
+    case 7: // output
+        param_info->id = pid_OUTPUT;
+        strncpy(param_info->name, "Output", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = 0.;
+        param_info->min_value = OUTPUT_MIN;
+        param_info->max_value = OUTPUT_MAX;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        param_info->cookie = NULL;
+        break;
+    case 8: // auto gain
+        param_info->id = pid_AUTO_GAIN;
+        strncpy(param_info->name, "Auto Gain", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = 0.;
+        param_info->min_value = 0;
+        param_info->max_value = 1;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
+        param_info->cookie = NULL;
+        break;
+    case 9: // bands
+        param_info->id = pid_BANDS;
+        strncpy(param_info->name, "Bands", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = 1.;
+        param_info->min_value = 1;
+        param_info->max_value = MAX_BANDS;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
+        param_info->cookie = NULL;
+        break;
+    case 10: // crossovers
+    case 11:
+    case 12:
+    {
+        int k = param_index - 10;
+        param_info->id = pid_CROSSOVER + k;
+        snprintf(param_info->name, CLAP_NAME_SIZE, "Crossover %d", k + 1);
+        param_info->module[0] = 0;
+        param_info->default_value = s_crossover_default[k];
+        param_info->min_value = s_crossover_min[k];
+        param_info->max_value = s_crossover_max[k];
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        param_info->cookie = NULL;
+    }
+    break;
+    case LOOKAHEAD_PARAM_INDEX:
+        param_info->id = pid_LOOKAHEAD;
+        strncpy(param_info->name, "Lookahead", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = 0.;
+        param_info->min_value = 0;
+        param_info->max_value = 1;
+        // Changes the latency, so it can't be automated
+        param_info->flags = CLAP_PARAM_IS_STEPPED;
+        param_info->cookie = NULL;
+        break;
+    case SIDECHAIN_PARAM_INDEX:
+        param_info->id = pid_SIDECHAIN;
+        strncpy(param_info->name, "Sidechain Drive", CLAP_NAME_SIZE);
+        param_info->module[0] = 0;
+        param_info->default_value = 0.;
+        param_info->min_value = -SIDECHAIN_RANGE;
+        param_info->max_value = SIDECHAIN_RANGE;
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        param_info->cookie = NULL;
+        break;
     default:
-        return false;
+    {
+        if (param_index >= c99dist_param_count(plugin))
+            return false;
+
+        int band = (param_index - BAND_PARAM_INDEX) / 3;
+        snprintf(param_info->module, CLAP_PATH_SIZE, "Band %d", band + 1);
+        param_info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+        param_info->cookie = NULL;
+        switch ((param_index - BAND_PARAM_INDEX) % 3)
+        {
+        case 0:
+            param_info->id = pid_BAND_MODE + band;
+            snprintf(param_info->name, CLAP_NAME_SIZE, "Band %d Mode", band + 1);
+            param_info->default_value = 0.;
+            param_info->min_value = 0;
+            param_info->max_value = CLIP_TYPE_COUNT - 1;
+            param_info->flags |= CLAP_PARAM_IS_STEPPED;
+            break;
+        case 1:
+        {
+            // same range as the main drive
+            clap_param_info_t drive;
+            c99dist_param_get_info(plugin, 0, &drive);
+            param_info->id = pid_BAND_DRIVE + band;
+            snprintf(param_info->name, CLAP_NAME_SIZE, "Band %d Drive", band + 1);
+            param_info->default_value = 0.;
+            param_info->min_value = drive.min_value;
+            param_info->max_value = drive.max_value;
+        }
+        break;
+        case 2:
+            param_info->id = pid_BAND_MIX + band;
+            snprintf(param_info->name, CLAP_NAME_SIZE, "Band %d Mix", band + 1);
+            param_info->default_value = 1.;
+            param_info->min_value = 0;
+            param_info->max_value = 1;
+            break;
+        }
+    }
+    break;
+    }
+
+    // Fixed variants show their mode as read only
+    const c99dist_variant *variant = ((clap_c99_distortion_plug *)plugin->plugin_data)->variant;
+    if (variant->mode >= 0 &&
+        (param_info->id == pid_MODE ||
+         (param_info->id >= pid_BAND_MODE && param_info->id < pid_BAND_MODE + MAX_BANDS)))
+    {
+        param_info->default_value = param_info->min_value = param_info->max_value = variant->mode;
+        param_info->flags = CLAP_PARAM_IS_STEPPED | CLAP_PARAM_IS_READONLY;
     }
     return true;
 }
 bool c99dist_param_get_value(const clap_plugin_t *plugin, clap_id param_id, double *value)
 {
     clap_c99_distortion_plug *plug = plugin->plugin_data;
+    const int index = c99dist_state_index(param_id);
+    if (index < 0)
+        return false;
 
-    switch (param_id)
-    {
-    case pid_DRIVE:
-        *value = plug->drive;
-        return true;
-        break;
+    // A loaded state reads back before the audio thread has applied it
+    c99dist_params_state params;
+    c99dist_params_current(plug, &params);
+    *value = params.v[index];
+    return true;
+}
+// Drive shows as the gain it applies, 1 + drive, in dB
+static bool c99dist_drive_to_text(double value, char *display, uint32_t size)
+{
+    if (value <= -1.)
+        return display_copy(display, size, "-inf dB");
+    return display_format(display, size, 20. * log10(1. + value), 2, "dB");
+}
 
-    case pid_MIX:
-        *value = plug->mix;
-        return true;
-        break;
+static bool c99dist_text_to_drive(const char *text, double *value)
+{
+    double db;
+    if (!display_parse_db(text, &db))
+        return false;
+    *value = db == -HUGE_VAL ? -1. : pow(10., db / 20.) - 1.;
+    return true;
+}
 
-    case pid_MODE:
-        *value = plug->mode;
-        return true;
-        break;
-    }
+// A number followed by unit, or by nothing
+static bool c99dist_text_to_number(const char *text, const char *unit, double *value)
+{
+    const char *rest;
+    double v;
+    if (!display_parse(text, &v, &rest) || !display_unit(rest, unit))
+        return false;
+    *value = v;
+    return true;
+}
 
-    return false;
+static bool c99dist_text_to_mode(const char *text, double *value)
+{
+    for (int i = 0; i < CLIP_TYPE_COUNT; i++)
+        if (display_match(text, s_shapers[i].name))
+        {
+            *value = i;
+            return true;
+        }
+    return c99dist_text_to_number(text, "", value);
 }
+
+static bool c99dist_text_to_hz(const char *text, double *value)
+{
+    const char *rest;
+    double v;
+    if (!display_parse(text, &v, &rest))
+        return false;
+    if (display_match(rest, "kHz"))
+        v *= 1000.;
+    else if (!display_unit(rest, "Hz"))
+        return false;
+    *value = v;
+    return true;
+}
+
 bool c99dist_param_value_to_text(const clap_plugin_t *plugin, clap_id param_id, double value,
                                  char *display, uint32_t size)
 {
-    clap_c99_distortion_plug *plug = plugin->plugin_data;
     switch (param_id)
     {
     case pid_DRIVE:
+        return c99dist_drive_to_text(value, display, size);
     case pid_MIX:
-        snprintf(display, size, "%f", value);
-        return true;
-        break;
+        return display_format(display, size, value * 100., 1, "%");
+    case pid_SIDECHAIN:
+        return display_format(display, size, value, 2, NULL);
     case pid_MODE:
     {
         int v = (int)value;
-        switch (v)
-        {
-        case 0:
-            snprintf(display, size, "Hard Clip");
-            break;
-        case 1:
-            snprintf(display, size, "Soft Clip (Tanh)");
-            break;
-        case 2:
-            snprintf(display, size, "Simple Folder");
-            break;
-        }
-
-        return true;
+        if (v < 0 || v >= CLIP_TYPE_COUNT)
+            return false;
+        return display_copy(display, size, s_shapers[v].name);
     }
-    break;
+    case pid_LOW_CUT:
+    case pid_HIGH_CUT:
+        if (param_id == pid_LOW_CUT ? value <= LOW_CUT_MIN : value >= HIGH_CUT_MAX)
+            return display_copy(display, size, "Off");
+        return display_format(display, size, value, 0, "Hz");
+    case pid_EMPHASIS:
+    case pid_OUTPUT:
+        return display_format(display, size, value, 1, "dB");
+    case pid_DC_BLOCK:
+    case pid_AUTO_GAIN:
+    case pid_LOOKAHEAD:
+        return display_copy(display, size, value >= 0.5 ? "On" : "Off");
+    case pid_BANDS:
+        if (value < 2)
+            return display_copy(display, size, "Off");
+        return display_format(display, size, (int)value, 0, "Bands");
     }
+
+    if (param_id >= pid_CROSSOVER && param_id < pid_CROSSOVER + MAX_CROSSOVERS)
+        return display_format(display, size, value, 0, "Hz");
+    else if (param_id >= pid_BAND_MODE && param_id < pid_BAND_MODE + MAX_BANDS)
+        return c99dist_param_value_to_text(plugin, pid_MODE, value, display, size);
+    else if (param_id >= pid_BAND_DRIVE && param_id < pid_BAND_DRIVE + MAX_BANDS)
+        return c99dist_drive_to_text(value, display, size);
+    else if (param_id >= pid_BAND_MIX && param_id < pid_BAND_MIX + MAX_BANDS)
+        return display_format(display, size, value * 100., 1, "%");
     return false;
 }
 bool c99dist_text_to_value(const clap_plugin_t *plugin, clap_id param_id, const char *display,
                            double *value)
 {
-    // I'm not going to bother to support this
+    // Accepts what value_to_text writes, and the bare number
+    switch (param_id)
+    {
+    case pid_DRIVE:
+        return c99dist_text_to_drive(display, value);
+    case pid_MIX:
+        if (!c99dist_text_to_number(display, "%", value))
+            return false;
+        *value /= 100.;
+        return true;
+    case pid_SIDECHAIN:
+        return c99dist_text_to_number(display, "", value);
+    case pid_MODE:
+        return c99dist_text_to_mode(display, value);
+    case pid_LOW_CUT:
+    case pid_HIGH_CUT:
+        if (display_match(display, "Off"))
+        {
+            *value = param_id == pid_LOW_CUT ? LOW_CUT_MIN : HIGH_CUT_MAX;
+            return true;
+        }
+        return c99dist_text_to_hz(display, value);
+    case pid_EMPHASIS:
+        return c99dist_text_to_number(display, "dB", value);
+    case pid_OUTPUT:
+        // -inf dB is as quiet as Output goes
+        if (!display_parse_db(display, value))
+            return false;
+        *value = *value < OUTPUT_MIN ? OUTPUT_MIN : *value;
+        return true;
+    case pid_DC_BLOCK:
+    case pid_AUTO_GAIN:
+    case pid_LOOKAHEAD:
+        if (display_match(display, "On") || display_match(display, "Off"))
+        {
+            *value = display_match(display, "On");
+            return true;
+        }
+        return c99dist_text_to_number(display, "", value);
+    case pid_BANDS:
+        if (display_match(display, "Off"))
+        {
+            *value = 1.;
+            return true;
+        }
+        return c99dist_text_to_number(display, "Bands", value);
+    }
+
+    if (param_id >= pid_CROSSOVER && param_id < pid_CROSSOVER + MAX_CROSSOVERS)
+        return c99dist_text_to_hz(display, value);
+    else if (param_id >= pid_BAND_MODE && param_id < pid_BAND_MODE + MAX_BANDS)
+        return c99dist_text_to_mode(display, value);
+    else if (param_id >= pid_BAND_DRIVE && param_id < pid_BAND_DRIVE + MAX_BANDS)
+        return c99dist_text_to_drive(display, value);
+    else if (param_id >= pid_BAND_MIX && param_id < pid_BAND_MIX + MAX_BANDS)
+    {
+        if (!c99dist_text_to_number(display, "%", value))
+            return false;
+        *value /= 100.;
+        return true;
+    }
     return false;
 }
 void c99dist_flush(const clap_plugin_t *plugin, const clap_input_events_t *in,
                    const clap_output_events_t *out)
 {
     clap_c99_distortion_plug *plug = plugin->plugin_data;
+
+    // A state loaded before these events is older than them, so it goes in first
+    c99dist_params_swap(plug);
+
     int s = in->size(in);
     int q;
     for (q = 0; q < s; ++q)
     {
         const clap_event_header_t *hdr = in->get(in, q);
 
-        c99dist_process_event(plug, hdr);
+        c99dist_process_event(plug, hdr, out);
     }
 }
 
@@ -418,6 +853,257 @@ static const clap_plugin_params_t s_c99dist_params = {.count = c99dist_param_cou
                                                       .text_to_value = c99dist_text_to_value,
                                                       .flush = c99dist_flush};
 
+/////////////////
+// clap_curves //
+/////////////////
+
+// Frees a curve the audio thread has finished with
+static void c99dist_curve_collect(clap_c99_distortion_plug *plug)
+{
+    curve_free(c99dist_atomic_xchg(&plug->curve_retired, NULL));
+}
+
+// Hands a new curve to the audio thread, which picks it up at the start of its next block.
+// A curve that was published but never picked up is freed here instead.
+static void c99dist_curve_publish(clap_c99_distortion_plug *plug, c99dist_curve *curve)
+{
+    c99dist_curve_collect(plug);
+    curve_free(c99dist_atomic_xchg(&plug->curve_pending, curve));
+    plug->curve_latest = curve;
+}
+
+// Audio thread side of the handoff. We only swap once the previous retiree has been collected,
+// so the audio thread never has to free anything.
+static void c99dist_curve_swap(clap_c99_distortion_plug *plug)
+{
+    if (c99dist_atomic_load(&plug->curve_retired))
+        return;
+    c99dist_curve *next = c99dist_atomic_xchg(&plug->curve_pending, NULL);
+    if (next)
+    {
+        c99dist_atomic_store(&plug->curve_retired, plug->dsp.curve);
+        plug->dsp.curve = next;
+        plug->host->request_callback(plug->host);
+    }
+}
+
+/////////////////////////////
+// clap_plugin_preset_load //
+/////////////////////////////
+
+// A preset is a curve file for the Curve modes (see curve_load_file), which hosts load from their
+// preset browser or when one is dropped on the plugin. It lands in the state like any curve.
+static bool c99dist_preset_load_from_location(const clap_plugin_t *plugin, uint32_t location_kind,
+                                              const char *location, const char *load_key)
+{
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+    const clap_host_preset_load_t *host_load = plug->hostPresetLoad;
+    c99dist_curve *curve = location_kind == CLAP_PRESET_DISCOVERY_LOCATION_FILE && location
+                               ? curve_load_file(location)
+                               : NULL;
+    if (!curve)
+    {
+        if (host_load)
+            host_load->on_error(plug->host, location_kind, location, load_key, 0,
+                                "not a curve file");
+        return false;
+    }
+    c99dist_curve_publish(plug, curve);
+    if (host_load)
+        host_load->loaded(plug->host, location_kind, location, load_key);
+    return true;
+}
+
+static const clap_plugin_preset_load_t s_c99dist_preset_load = {
+    .from_location = c99dist_preset_load_from_location,
+};
+
+////////////////
+// clap_state //
+////////////////
+
+static bool c99dist_stream_write(const clap_ostream_t *stream, const void *data, int size)
+{
+    int written = 0;
+    const char *curr = data;
+    while (written != size)
+    {
+        int thiswrite = stream->write(stream, curr, size - written);
+        if (thiswrite <= 0)
+            return false;
+        curr += thiswrite;
+        written += thiswrite;
+    }
+    return true;
+}
+
+static bool c99dist_stream_read(const clap_istream_t *stream, void *data, int size)
+{
+    int read = 0;
+    char *curr = data;
+    while (read != size)
+    {
+        int thisread = stream->read(stream, curr, size - read);
+        if (thisread <= 0)
+            return false;
+        curr += thisread;
+        read += thisread;
+    }
+    return true;
+}
+
+#define C99DIST_STATE_VERSION 7
+
+// What the audio thread runs with. Only exact while it isn't running, see c99dist_params_current.
+static void c99dist_params_from_dsp(const clap_c99_distortion_plug *plug, float *v)
+{
+    v[sidx_DRIVE] = plug->dsp.drive;
+    v[sidx_MIX] = plug->dsp.mix;
+    v[sidx_MODE] = (float)plug->dsp.mode;
+    v[sidx_LOW_CUT] = plug->dsp.low_cut;
+    v[sidx_EMPHASIS] = plug->dsp.emphasis;
+    v[sidx_HIGH_CUT] = plug->dsp.high_cut;
+    v[sidx_DC_BLOCK] = plug->dsp.dc_block;
+    v[sidx_OUTPUT] = plug->dsp.output;
+    v[sidx_AUTO_GAIN] = plug->dsp.auto_gain;
+    v[sidx_LOOKAHEAD] = plug->dsp.lookahead;
+    v[sidx_SIDECHAIN] = plug->dsp.sidechain;
+
+    float *a = v + sidx_BANDS;
+    *a++ = (float)plug->dsp.bands;
+    for (int k = 0; k < MAX_CROSSOVERS; k++)
+        *a++ = plug->dsp.crossover[k];
+    for (int b = 0; b < MAX_BANDS; b++)
+    {
+        *a++ = (float)plug->dsp.band_mode[b];
+        *a++ = plug->dsp.band_drive[b];
+        *a++ = plug->dsp.band_mix[b];
+    }
+}
+
+// Once processing may run only the audio thread calls this, through c99dist_params_swap
+static void c99dist_params_to_dsp(clap_c99_distortion_plug *plug, const float *v)
+{
+    plug->dsp.drive = v[sidx_DRIVE];
+    plug->dsp.mix = v[sidx_MIX];
+    plug->dsp.mode = (int32_t)v[sidx_MODE];
+    plug->dsp.low_cut = v[sidx_LOW_CUT];
+    plug->dsp.emphasis = v[sidx_EMPHASIS];
+    plug->dsp.high_cut = v[sidx_HIGH_CUT];
+    plug->dsp.dc_block = v[sidx_DC_BLOCK] >= 0.5f;
+    plug->dsp.output = v[sidx_OUTPUT];
+    plug->dsp.auto_gain = v[sidx_AUTO_GAIN] >= 0.5f;
+    plug->dsp.lookahead = v[sidx_LOOKAHEAD] >= 0.5f;
+    plug->dsp.sidechain = v[sidx_SIDECHAIN];
+    plug->dsp.filters_dirty = true;
+
+    // A new band count changes the shape of the crossover tree, so its state starts over
+    const float *a = v + sidx_BANDS;
+    const int32_t bands = (int32_t)*a++;
+    if (bands != plug->dsp.bands)
+        crossover_reset(&plug->dsp.xover);
+    plug->dsp.bands = bands;
+    for (int k = 0; k < MAX_CROSSOVERS; k++)
+        plug->dsp.crossover[k] = *a++;
+    for (int b = 0; b < MAX_BANDS; b++)
+    {
+        plug->dsp.band_mode[b] = (int32_t)*a++;
+        plug->dsp.band_drive[b] = *a++;
+        plug->dsp.band_mix[b] = *a++;
+    }
+    plug->dsp.crossover_dirty = true;
+}
+
+static void c99dist_params_default(float *v)
+{
+    v[sidx_DRIVE] = 0.f;
+    v[sidx_MIX] = 0.5f;
+    v[sidx_MODE] = (float)HARD;
+    v[sidx_LOW_CUT] = LOW_CUT_MIN;
+    v[sidx_EMPHASIS] = 0.f;
+    v[sidx_HIGH_CUT] = HIGH_CUT_MAX;
+    v[sidx_DC_BLOCK] = 1.f;
+    v[sidx_OUTPUT] = 0.f;
+    v[sidx_AUTO_GAIN] = 0.f;
+    v[sidx_LOOKAHEAD] = 0.f;
+    v[sidx_SIDECHAIN] = 0.f;
+
+    float *a = v + sidx_BANDS;
+    *a++ = 1.f;
+    for (int k = 0; k < MAX_CROSSOVERS; k++)
+        *a++ = s_crossover_default[k];
+    for (int b = 0; b < MAX_BANDS; b++)
+    {
+        *a++ = (float)HARD;
+        *a++ = 0.f;
+        *a++ = 1.f;
+    }
+}
+
+// Pulls every value into the range of its parameter, NaN included, which also pins the modes of
+// a fixed variant
+static void c99dist_params_validate(const clap_c99_distortion_plug *plug, float *v)
+{
+    const uint32_t count = c99dist_param_count(&plug->plugin);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        clap_param_info_t info;
+        const int index = c99dist_param_get_info(&plug->plugin, i, &info)
+                              ? c99dist_state_index(info.id)
+                              : -1;
+        if (index < 0)
+            continue;
+        if (!(v[index] >= info.min_value))
+            v[index] = (float)info.min_value;
+        else if (v[index] > info.max_value)
+            v[index] = (float)info.max_value;
+    }
+}
+
+// Frees a loaded state the audio thread has finished with
+static void c99dist_params_collect(clap_c99_distortion_plug *plug)
+{
+    c99dist_free(c99dist_atomic_xchg(&plug->params_retired, NULL));
+}
+
+// Hands a loaded state to the audio thread like c99dist_curve_publish does curves
+static bool c99dist_params_publish(clap_c99_distortion_plug *plug, const c99dist_params_state *in)
+{
+    c99dist_params_state *params = c99dist_calloc(1, sizeof(*params));
+    if (!params)
+        return false;
+    *params = *in;
+    c99dist_params_collect(plug);
+    c99dist_free(c99dist_atomic_xchg(&plug->params_pending, params));
+    return true;
+}
+
+// Audio thread side, the same handoff as c99dist_curve_swap
+static void c99dist_params_swap(clap_c99_distortion_plug *plug)
+{
+    if (c99dist_atomic_load(&plug->params_retired))
+        return;
+    c99dist_params_state *next = c99dist_atomic_xchg(&plug->params_pending, NULL);
+    if (next)
+    {
+        c99dist_params_to_dsp(plug, next->v);
+        c99dist_atomic_store(&plug->params_retired, next);
+        plug->host->request_callback(plug->host);
+    }
+}
+
+// The values get_value and save report: a loaded state the audio thread hasn't picked up yet, or
+// else what it runs with. Only the main thread frees a published state, so one read here stays
+// valid even if the audio thread takes it meanwhile.
+static void c99dist_params_current(const clap_c99_distortion_plug *plug, c99dist_params_state *out)
+{
+    const c99dist_params_state *pending = c99dist_atomic_load(&plug->params_pending);
+    if (pending)
+        *out = *pending;
+    else
+        c99dist_params_from_dsp(plug, out->v);
+}
+
 bool c99dist_state_save(const clap_plugin_t *plugin, const clap_ostream_t *stream)
 {
     clap_c99_distortion_plug *plug = plugin->plugin_data;
@@ -427,53 +1113,116 @@ bool c99dist_state_save(const clap_plugin_t *plugin, const clap_ostream_t *strea
     assert(sizeof(float) == 4);
     assert(sizeof(int32_t) == 4);
 
+    c99dist_params_state params;
+    c99dist_params_current(plug, &params);
+    const float *v = params.v;
+
     int buffersize = 16;
     char buffer[16];
 
-    int32_t version = 1;
+    int32_t version = C99DIST_STATE_VERSION;
+    int32_t mode = (int32_t)v[sidx_MODE];
     memcpy(buffer, &version, sizeof(int32_t));
-    memcpy(buffer + 4, &(plug->drive), sizeof(float));
-    memcpy(buffer + 8, &(plug->mix), sizeof(float));
-    memcpy(buffer + 12, &(plug->mode), sizeof(int32_t));
+    memcpy(buffer + 4, &v[sidx_DRIVE], sizeof(float));
+    memcpy(buffer + 8, &v[sidx_MIX], sizeof(float));
+    memcpy(buffer + 12, &mode, sizeof(int32_t));
 
-    int written = 0;
-    char *curr = buffer;
-    while (written != buffersize)
-    {
-        int thiswrite = stream->write(stream, curr, buffersize - written);
-        if (thiswrite < 0)
-            return false;
-        curr += thiswrite;
-        written += thiswrite;
-    }
+    if (!c99dist_stream_write(stream, buffer, buffersize))
+        return false;
 
-    return true;
+    // Version 2: the curve control points
+    const c99dist_curve *curve = plug->curve_latest;
+    if (!c99dist_stream_write(stream, &curve->num_points, sizeof(uint32_t)) ||
+        !c99dist_stream_write(stream, curve->points, curve->num_points * 2 * sizeof(float)))
+        return false;
+
+    // Version 3: tone shaping filters, low cut, emphasis and high cut
+    if (!c99dist_stream_write(stream, &v[sidx_LOW_CUT], 3 * sizeof(float)))
+        return false;
+
+    // Version 4: output stage, DC blocker, output and auto gain
+    if (!c99dist_stream_write(stream, &v[sidx_DC_BLOCK], 3 * sizeof(float)))
+        return false;
+
+    // Version 5: multiband
+    if (!c99dist_stream_write(stream, &v[sidx_BANDS], C99DIST_BANDS_STATE_SIZE * sizeof(float)))
+        return false;
+
+    // Version 6: lookahead
+    if (!c99dist_stream_write(stream, &v[sidx_LOOKAHEAD], sizeof(float)))
+        return false;
+
+    // Version 7: sidechain
+    return c99dist_stream_write(stream, &v[sidx_SIDECHAIN], sizeof(float));
 }
 
+// The audio thread may be running, so nothing goes into dsp from here. The whole chunk is read and
+// checked first, then its values and curve are handed over like the curve alone used to be.
 bool c99dist_state_load(const clap_plugin_t *plugin, const clap_istream_t *stream)
 {
     clap_c99_distortion_plug *plug = plugin->plugin_data;
 
+    c99dist_params_state params;
+    float *v = params.v;
+    c99dist_params_default(v);
+
     int buffersize = 16;
     char buffer[16];
 
-    int read = 0;
-    char *curr = buffer;
-    while (read != buffersize)
+    if (!c99dist_stream_read(stream, buffer, buffersize))
+        return false;
+
+    int32_t version, mode;
+    memcpy(&version, buffer, sizeof(int32_t));
+    memcpy(&v[sidx_DRIVE], buffer + 4, sizeof(float));
+    memcpy(&v[sidx_MIX], buffer + 8, sizeof(float));
+    memcpy(&mode, buffer + 12, sizeof(int32_t));
+    v[sidx_MODE] = (float)mode;
+    if (version < 1 || version > C99DIST_STATE_VERSION)
+        return false;
+
+    uint32_t num_points = 0;
+    float points[CURVE_MAX_POINTS][2];
+    if (version >= 2)
     {
-        int thisread = stream->read(stream, curr, buffersize - read);
-        if (thisread < 0)
+        if (!c99dist_stream_read(stream, &num_points, sizeof(uint32_t)) ||
+            num_points > CURVE_MAX_POINTS ||
+            !c99dist_stream_read(stream, points, num_points * 2 * sizeof(float)))
             return false;
-        curr += thisread;
-        read += thisread;
     }
 
-    int32_t version;
-    memcpy(&version, buffer, sizeof(int32_t));
-    memcpy(&plug->drive, buffer + 4, sizeof(float));
-    memcpy(&plug->mix, buffer + 8, sizeof(float));
-    memcpy(&plug->mode, buffer + 12, sizeof(int32_t));
+    if (version >= 3 && !c99dist_stream_read(stream, &v[sidx_LOW_CUT], 3 * sizeof(float)))
+        return false;
+
+    // Sessions from before version 4 had no DC blocker, keep them sounding the same
+    v[sidx_DC_BLOCK] = 0.f;
+    if (version >= 4 && !c99dist_stream_read(stream, &v[sidx_DC_BLOCK], 3 * sizeof(float)))
+        return false;
+
+    if (version >= 5 &&
+        !c99dist_stream_read(stream, &v[sidx_BANDS], C99DIST_BANDS_STATE_SIZE * sizeof(float)))
+        return false;
+
+    if (version >= 6 && !c99dist_stream_read(stream, &v[sidx_LOOKAHEAD], sizeof(float)))
+        return false;
+
+    if (version >= 7 && !c99dist_stream_read(stream, &v[sidx_SIDECHAIN], sizeof(float)))
+        return false;
 
+    c99dist_params_validate(plug, v);
+    c99dist_curve *curve = curve_create((const float(*)[2])points, num_points);
+    if (!curve)
+        return false;
+    if (!c99dist_params_publish(plug, &params))
+    {
+        curve_free(curve);
+        return false;
+    }
+    c99dist_curve_publish(plug, curve);
+
+    // Lookahead changes the latency, which only happens through a restart
+    if ((v[sidx_LOOKAHEAD] >= 0.5f) != plug->dsp.lookahead_active)
+        plug->host->request_restart(plug->host);
     return true;
 }
 static const clap_plugin_state_t s_c99dist_state = {.save = c99dist_state_save,
@@ -491,55 +1240,276 @@ static bool c99dist_init(const struct clap_plugin *plugin)
     plug->hostLatency = plug->host->get_extension(plug->host, CLAP_EXT_LATENCY);
     plug->hostLog = plug->host->get_extension(plug->host, CLAP_EXT_LOG);
     plug->hostThreadCheck = plug->host->get_extension(plug->host, CLAP_EXT_THREAD_CHECK);
+    plug->hostThreadPool = plug->host->get_extension(plug->host, CLAP_EXT_THREAD_POOL);
     plug->hostParams = plug->host->get_extension(plug->host, CLAP_EXT_PARAMS);
     plug->hostTimerSupport = plug->host->get_extension(plug->host, CLAP_EXT_TIMER_SUPPORT);
-
-    plug->drive = 0.f;
-    plug->mix = 0.5f;
-    plug->mode = HARD;
-    return true;
+    plug->hostPresetLoad = plug->host->get_extension(plug->host, CLAP_EXT_PRESET_LOAD);
+    if (!plug->hostPresetLoad)
+        plug->hostPresetLoad = plug->host->get_extension(plug->host, CLAP_EXT_PRESET_LOAD_COMPAT);
+
+    c99dist_params_state params;
+    c99dist_params_default(params.v);
+    c99dist_params_validate(plug, params.v);
+    c99dist_params_to_dsp(plug, params.v);
+    plug->dsp.sample_rate = 48000;
+
+    // The audio thread isn't running yet so we can install the default curve directly
+    plug->dsp.curve = curve_create(NULL, 0);
+    plug->curve_latest = plug->dsp.curve;
+    return plug->dsp.curve != NULL;
 }
 
 static void c99dist_destroy(const struct clap_plugin *plugin)
 {
     clap_c99_distortion_plug *plug = plugin->plugin_data;
-    free(plug);
+    curve_free(plug->dsp.curve);
+    curve_free(plug->curve_pending);
+    curve_free(plug->curve_retired);
+    c99dist_free(plug->params_pending);
+    c99dist_free(plug->params_retired);
+    c99dist_aligned_free(plug);
 }
 
 static bool c99dist_activate(const struct clap_plugin *plugin, double sample_rate,
                              uint32_t min_frames_count, uint32_t max_frames_count)
 {
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+
+    // Nothing is processing, so a state loaded since can go in directly. Lookahead has to be
+    // known before the buffers are sized.
+    c99dist_params_state *loaded = c99dist_atomic_xchg(&plug->params_pending, NULL);
+    if (loaded)
+    {
+        c99dist_params_to_dsp(plug, loaded->v);
+        c99dist_free(loaded);
+    }
+
+    plug->dsp.sample_rate = sample_rate;
+    plug->dsp.filters_dirty = true;
+    filters_reset(&plug->dsp.filters);
+
+    const uint32_t old_latency = c99dist_latency_get(plugin);
+    plug->dsp.lookahead_active = plug->dsp.lookahead;
+    const uint32_t la_length = plug->dsp.lookahead_active ? lookahead_length(sample_rate) : 0;
+    const uint32_t la_ring = lookahead_ring_size(la_length);
+
+    // One arena holds every buffer process() needs. Each buffer is sized here with room for its
+    // alignment, then carved out below.
+    const size_t band_bytes = sizeof(float) * MAX_BANDS * 2 * max_frames_count;
+    const size_t la_bytes = sizeof(float) * 2 * 2 * max_frames_count;
+    const size_t la_delay_bytes = sizeof(float) * VF_WIDTH * la_ring;
+    const size_t la_deque_bytes = (sizeof(uint32_t) + sizeof(float)) * la_ring;
+    const size_t sc_bytes = sizeof(float) * (1 + MAX_BANDS) * max_frames_count;
+    const size_t arena_size =
+        band_bytes + la_bytes + la_delay_bytes + la_deque_bytes + sc_bytes + 6 * XARENA_ALIGN;
+
+    plug->arena_mem = c99dist_aligned_calloc(arena_size);
+    if (!plug->arena_mem)
+        return false;
+    xarena_init(&plug->arena, plug->arena_mem, arena_size);
+    plug->dsp.band_buffer = xarena_alloc(&plug->arena, band_bytes);
+    plug->dsp.lookahead_buffer = xarena_alloc(&plug->arena, la_bytes);
+    float(*la_delay)[VF_WIDTH] = xarena_alloc(&plug->arena, la_delay_bytes);
+    uint32_t *la_pos = xarena_alloc(&plug->arena, sizeof(uint32_t) * la_ring);
+    float *la_peak = xarena_alloc(&plug->arena, sizeof(float) * la_ring);
+    lookahead_init(&plug->dsp.la, la_length, sample_rate, la_delay, la_pos, la_peak);
+    plug->dsp.sidechain_buffer = xarena_alloc(&plug->arena, sc_bytes);
+    follower_init(&plug->dsp.follower, sample_rate);
+    plug->dsp.max_frames = max_frames_count;
+
+    if (c99dist_latency_get(plugin) != old_latency && plug->hostLatency)
+        plug->hostLatency->changed(plug->host);
+#if C99DIST_VALIDATE
+    plug->dsp.validate_logged = 0;
+#endif
+    plug->dsp.crossover_dirty = true;
+    crossover_reset(&plug->dsp.xover);
+    plug->dsp.drive_mod = 0.f;
     return true;
 }
 
-static void c99dist_deactivate(const struct clap_plugin *plugin) {}
+static void c99dist_deactivate(const struct clap_plugin *plugin)
+{
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+    c99dist_aligned_free(plug->arena_mem);
+    plug->arena_mem = NULL;
+    plug->dsp.band_buffer = NULL;
+    plug->dsp.lookahead_buffer = NULL;
+    plug->dsp.sidechain_buffer = NULL;
+    plug->dsp.max_frames = 0;
+}
 
 static bool c99dist_start_processing(const struct clap_plugin *plugin) { return true; }
 
 static void c99dist_stop_processing(const struct clap_plugin *plugin) {}
 
-static void c99dist_reset(const struct clap_plugin *plugin) {}
+static void c99dist_reset(const struct clap_plugin *plugin)
+{
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+    filters_reset(&plug->dsp.filters);
+    crossover_reset(&plug->dsp.xover);
+    plug->dsp.crossover_dirty = true;
+    lookahead_reset(&plug->dsp.la);
+    follower_reset(&plug->dsp.follower);
+    plug->dsp.drive_mod = 0.f;
+}
+
+// Only called when a filter parameter or the sample rate changed
+static void c99dist_update_filters(clap_c99_distortion_plug *plug)
+{
+    c99dist_filters *f = &plug->dsp.filters;
+    const double sr = plug->dsp.sample_rate;
+    const bool low_cut = plug->dsp.low_cut > LOW_CUT_MIN;
+    const bool emphasis = plug->dsp.emphasis != 0.f;
+    const bool high_cut = plug->dsp.high_cut < HIGH_CUT_MAX && plug->dsp.high_cut < 0.45 * sr;
+
+    if (low_cut)
+        biquad_highpass(&f->c[FILTER_LOW_CUT], plug->dsp.low_cut, sr);
+    else
+        biquad_identity(&f->c[FILTER_LOW_CUT]);
+
+    if (emphasis)
+    {
+        biquad_tilt(&f->c[FILTER_EMPHASIS], plug->dsp.emphasis, EMPHASIS_FREQ, sr);
+        biquad_tilt(&f->c[FILTER_DEEMPHASIS], -plug->dsp.emphasis, EMPHASIS_FREQ, sr);
+    }
+    else
+    {
+        biquad_identity(&f->c[FILTER_EMPHASIS]);
+        biquad_identity(&f->c[FILTER_DEEMPHASIS]);
+    }
+
+    if (high_cut)
+        biquad_lowpass(&f->c[FILTER_HIGH_CUT], plug->dsp.high_cut, sr);
+    else
+        biquad_identity(&f->c[FILTER_HIGH_CUT]);
+
+    if (plug->dsp.dc_block)
+        biquad_dc_block(&f->c[FILTER_DC_BLOCK], DC_BLOCK_FREQ, sr);
+    else
+        biquad_identity(&f->c[FILTER_DC_BLOCK]);
+
+    uint32_t live = 0;
+    if (low_cut)
+        live |= FILTER_BIT(FILTER_LOW_CUT);
+    if (emphasis)
+        live |= FILTER_BIT(FILTER_EMPHASIS) | FILTER_BIT(FILTER_DEEMPHASIS);
+    if (high_cut)
+        live |= FILTER_BIT(FILTER_HIGH_CUT);
+    if (plug->dsp.dc_block)
+        live |= FILTER_BIT(FILTER_DC_BLOCK);
+    filters_set_live(f, live);
+    plug->dsp.filters_dirty = false;
+}
+
+// Only called when the band count, a crossover or the sample rate changed. The frequencies are
+// kept increasing and below Nyquist so the tree always splits cleanly.
+static void c99dist_update_crossover(clap_c99_distortion_plug *plug)
+{
+    float freqs[MAX_CROSSOVERS];
+    float lo = s_crossover_min[0];
+    for (int k = 0; k < MAX_CROSSOVERS; k++)
+    {
+        float f = plug->dsp.crossover[k];
+        f = f < lo ? lo : f;
+        f = f > 0.45f * plug->dsp.sample_rate ? 0.45f * plug->dsp.sample_rate : f;
+        freqs[k] = f;
+        lo = f;
+    }
+    crossover_update(&plug->dsp.xover, freqs, plug->dsp.bands, plug->dsp.sample_rate);
+    plug->dsp.crossover_dirty = false;
+}
+
+static void c99dist_set_band_param(clap_c99_distortion_plug *plug, clap_id param_id,
+                                   double value)
+{
+    if (param_id >= pid_CROSSOVER && param_id < pid_CROSSOVER + MAX_CROSSOVERS)
+    {
+        plug->dsp.crossover[param_id - pid_CROSSOVER] = value;
+        plug->dsp.crossover_dirty = true;
+    }
+    else if (param_id >= pid_BAND_MODE && param_id < pid_BAND_MODE + MAX_BANDS)
+        plug->dsp.band_mode[param_id - pid_BAND_MODE] = c99dist_lock_mode(plug, (int32_t)value);
+    else if (param_id >= pid_BAND_DRIVE && param_id < pid_BAND_DRIVE + MAX_BANDS)
+        plug->dsp.band_drive[param_id - pid_BAND_DRIVE] = value;
+    else if (param_id >= pid_BAND_MIX && param_id < pid_BAND_MIX + MAX_BANDS)
+        plug->dsp.band_mix[param_id - pid_BAND_MIX] = value;
+}
 
-static void c99dist_process_event(clap_c99_distortion_plug *plug, const clap_event_header_t *hdr)
+static void c99dist_process_event(clap_c99_distortion_plug *plug, const clap_event_header_t *hdr,
+                                  const clap_output_events_t *out)
 {
     if (hdr->space_id == CLAP_CORE_EVENT_SPACE_ID)
     {
         switch (hdr->type)
         {
+        case CLAP_EVENT_PARAM_MOD:
+        {
+            // Per note modulation has no voice to go to, see the Drive parameter
+            const clap_event_param_mod_t *ev = (const clap_event_param_mod_t *)hdr;
+            if (ev->param_id == pid_DRIVE && ev->note_id < 0 && ev->channel < 0 && ev->key < 0)
+                plug->dsp.drive_mod = ev->amount;
+            break;
+        }
         case CLAP_EVENT_PARAM_VALUE:
         {
             const clap_event_param_value_t *ev = (const clap_event_param_value_t *)hdr;
-            // TODO: handle parameter change
             switch (ev->param_id)
             {
             case pid_DRIVE:
-                plug->drive = ev->value;
+                plug->dsp.drive = ev->value;
                 break;
             case pid_MIX:
-                plug->mix = ev->value;
+                plug->dsp.mix = ev->value;
                 break;
             case pid_MODE:
-                plug->mode = (int)(ev->value);
+                plug->dsp.mode = c99dist_lock_mode(plug, (int32_t)ev->value);
+                break;
+            case pid_LOW_CUT:
+                plug->dsp.low_cut = ev->value;
+                plug->dsp.filters_dirty = true;
+                break;
+            case pid_EMPHASIS:
+                plug->dsp.emphasis = ev->value;
+                plug->dsp.filters_dirty = true;
+                break;
+            case pid_HIGH_CUT:
+                plug->dsp.high_cut = ev->value;
+                plug->dsp.filters_dirty = true;
+                break;
+            case pid_DC_BLOCK:
+                plug->dsp.dc_block = ev->value >= 0.5;
+                plug->dsp.filters_dirty = true;
+                break;
+            case pid_OUTPUT:
+                plug->dsp.output = ev->value;
+                break;
+            case pid_AUTO_GAIN:
+                plug->dsp.auto_gain = ev->value >= 0.5;
+                break;
+            case pid_BANDS:
+            {
+                int32_t bands = c99dist_clamp_bands((int32_t)ev->value);
+                if (bands != plug->dsp.bands)
+                {
+                    // The tree changes shape, old band state would click
+                    crossover_reset(&plug->dsp.xover);
+                    plug->dsp.bands = bands;
+                    plug->dsp.crossover_dirty = true;
+                }
+                break;
+            }
+            case pid_LOOKAHEAD:
+                plug->dsp.lookahead = ev->value >= 0.5;
+                // Takes effect on the next activate, where the new latency is reported
+                if (plug->dsp.lookahead != plug->dsp.lookahead_active)
+                    plug->host->request_restart(plug->host);
+                break;
+            case pid_SIDECHAIN:
+                plug->dsp.sidechain = ev->value;
+                break;
+            default:
+                c99dist_set_band_param(plug, ev->param_id, ev->value);
                 break;
             }
             break;
@@ -548,14 +1518,213 @@ static void c99dist_process_event(clap_c99_distortion_plug *plug, const clap_eve
     }
 }
 
-static clap_process_status c99dist_process(const struct clap_plugin *plugin,
-                                           const clap_process_t *process)
+// Shapes band b in place with its own mode, drive and mix. Bands share nothing but the
+// parameters, which don't change during a block, so they can run on any thread.
+C99DIST_INLINE void c99dist_shape_band(clap_c99_distortion_plug *plug, float *const *band,
+                                       int32_t b, uint32_t n, const float *lut, const float *env,
+                                       int32_t fixed_mode, uint32_t nch)
 {
-    if (process->audio_inputs_count == 1)
-        return CLAP_PROCESS_ERROR;
+    const int32_t mode = fixed_mode < 0 ? plug->dsp.band_mode[b] : fixed_mode;
+    const float gain = c99dist_drive_gain(mode, plug->dsp.band_drive[b]);
+    const float comp = plug->dsp.auto_gain ? 1.f / sqrtf(gain > 0.1f ? gain : 0.1f) : 1.f;
+    const float mix = plug->dsp.band_mix[b];
+    if (env)
+    {
+        const c99dist_shaper *shaper = &s_shapers[mode];
+        float *gains = plug->dsp.sidechain_buffer + (size_t)(1 + b) * plug->dsp.max_frames;
+        sidechain_gains(env, gains, n, plug->dsp.band_drive[b], plug->dsp.sidechain,
+                        shaper->drive_min, shaper->drive_max);
+        for (uint32_t c = 0; c < nch; c++)
+            shaper_block_mod(mode, band[c], band[c], n, gains, mix * comp, 1.f - mix, lut);
+    }
+    else
+    {
+        for (uint32_t c = 0; c < nch; c++)
+            shaper_block(mode, band[c], band[c], n, gain, mix * comp, 1.f - mix, lut);
+    }
+}
+
+//////////////////////////////
+// clap_plugin_thread_pool //
+//////////////////////////////
 
+// Blocks shorter than this shape their bands serially. Waking a worker takes microseconds and a
+// band costs tens of nanoseconds per frame, so only blocks of a few hundred frames win back the
+// handoff by running bands side by side. Provisional until tests/scaling.c has been run on
+// multicore machines, whose break even figures are what this should follow.
+#define THREAD_POOL_MIN_FRAMES 256
+
+// One task per band, called by host workers from inside c99dist_process_bands
+static void c99dist_thread_pool_exec(const clap_plugin_t *plugin, uint32_t task_index)
+{
     clap_c99_distortion_plug *plug = plugin->plugin_data;
+    const c99dist_band_task *task = &plug->dsp.task;
+
+    // Workers come with whatever FP mode the host gave them, and are held to the same rules as
+    // process()
+    C99DIST_PROCESS_BEGIN();
+    simd_fp_mode fp_mode = simd_flush_denormals();
+    c99dist_shape_band(plug, task->bands[task_index], task_index, task->frames, task->lut,
+                       task->env, plug->variant->mode, plug->variant->channels);
+    simd_restore_fp_mode(fp_mode);
+    C99DIST_PROCESS_END();
+}
+
+static const clap_plugin_thread_pool_t s_c99dist_thread_pool = {
+    .exec = c99dist_thread_pool_exec,
+};
+
+// Split, shape every band, then sum and mix. The main drive and mode are not used here, the main
+// mix and output gain are. dry_in is what gets mixed back in, which differs from in when the
+// lookahead has scaled it. num_bands is the band count read once for the block, so nothing can
+// change it halfway. env is the sidechain envelope, or NULL when the sidechain is off. The bands
+// are shaped on the host's thread pool when it has one.
+C99DIST_INLINE void c99dist_process_bands(clap_c99_distortion_plug *plug, const float *const *in,
+                                          const float *const *dry_in, float *const *out,
+                                          uint32_t n, int32_t num_bands, const float *lut,
+                                          const float *env, int32_t fixed_mode, uint32_t nch)
+{
+    if (plug->dsp.crossover_dirty)
+        c99dist_update_crossover(plug);
+
+    float *bands[MAX_BANDS][2];
+    for (int32_t b = 0; b < num_bands; b++)
+        for (uint32_t c = 0; c < nch; c++)
+            bands[b][c] = plug->dsp.band_buffer + (size_t)(b * 2 + c) * plug->dsp.max_frames;
+
+    crossover_split(&plug->dsp.xover, in, bands, nch, num_bands, n);
+
+    // request_exec returns once every task has run, or false if the host won't run them now
+    plug->dsp.task.bands = bands;
+    plug->dsp.task.lut = lut;
+    plug->dsp.task.env = env;
+    plug->dsp.task.frames = n;
+    if (n < THREAD_POOL_MIN_FRAMES || !plug->hostThreadPool ||
+        !plug->hostThreadPool->request_exec(plug->host, num_bands))
+    {
+        for (int32_t b = 0; b < num_bands; b++)
+            c99dist_shape_band(plug, bands[b], b, n, lut, env, fixed_mode, nch);
+    }
+
+    const float output = powf(10.f, plug->dsp.output / 20.f);
+    crossover_sum(bands, dry_in, out, nch, num_bands, n, plug->dsp.mix * output,
+                  (1.f - plug->dsp.mix) * output);
+}
+
+#if C99DIST_VALIDATE
+enum
+{
+    VALIDATE_EVENT_ORDER = 1 << 0,
+    VALIDATE_ALIASING = 1 << 1,
+    VALIDATE_NON_FINITE = 1 << 2,
+    VALIDATE_DENORMAL = 1 << 3
+};
+
+static void c99dist_validate_report(clap_c99_distortion_plug *plug, uint32_t problem,
+                                    clap_log_severity severity, const char *msg)
+{
+    if (plug->dsp.validate_logged & problem)
+        return;
+    plug->dsp.validate_logged |= problem;
+    if (plug->hostLog)
+        plug->hostLog->log(plug->host, severity, msg);
+}
+
+static bool c99dist_overlaps(const float *a, const float *b, uint32_t n)
+{
+    return a != b && a < b + n && b < a + n;
+}
+
+// Checks the parts of the CLAP contract that c99dist_process_audio takes on trust. Only compiled
+// when C99DIST_VALIDATE is set, the release path pays nothing for it.
+static void c99dist_validate(clap_c99_distortion_plug *plug, const clap_process_t *process,
+                             uint32_t nch)
+{
+    const uint32_t n = process->frames_count;
+
+    uint32_t last = 0;
+    for (uint32_t e = 0; e < process->in_events->size(process->in_events); e++)
+    {
+        const clap_event_header_t *hdr = process->in_events->get(process->in_events, e);
+        if (hdr->time < last || hdr->time >= n)
+            c99dist_validate_report(plug, VALIDATE_EVENT_ORDER, CLAP_LOG_HOST_MISBEHAVING,
+                                    "c99dist: event times out of order or past the block");
+        last = hdr->time;
+    }
+
+    // In place processing is fine, partially overlapping buffers are not
+    float *const *in = process->audio_inputs[0].data32;
+    float *const *out = process->audio_outputs[0].data32;
+    for (uint32_t a = 0; a < nch; a++)
+        for (uint32_t b = 0; b < nch; b++)
+            if (c99dist_overlaps(in[a], out[b], n) || (a < b && out[a] == out[b]) ||
+                (a < b && c99dist_overlaps(out[a], out[b], n)))
+                c99dist_validate_report(plug, VALIDATE_ALIASING, CLAP_LOG_HOST_MISBEHAVING,
+                                        "c99dist: audio buffers overlap");
+
+    for (uint32_t c = 0; c < nch; c++)
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (!isfinite(in[c][i]))
+                c99dist_validate_report(plug, VALIDATE_NON_FINITE, CLAP_LOG_WARNING,
+                                        "c99dist: NaN or infinite input");
+            else if (fpclassify(in[c][i]) == FP_SUBNORMAL)
+                c99dist_validate_report(plug, VALIDATE_DENORMAL, CLAP_LOG_WARNING,
+                                        "c99dist: denormal input");
+        }
+}
+#endif
+
+// The largest drive gain in use, which sets how far the lookahead has to pull peaks down. drive
+// is the single band drive, extra the most drive the sidechain can add on top.
+C99DIST_INLINE float c99dist_limit_gain(const clap_c99_distortion_plug *plug, int32_t fixed_mode,
+                                        int32_t num_bands, float drive, float extra)
+{
+    float gain = 0.f;
+    if (num_bands > 1)
+    {
+        for (int32_t b = 0; b < num_bands; b++)
+        {
+            const int32_t mode = fixed_mode < 0 ? plug->dsp.band_mode[b] : fixed_mode;
+            const float g = c99dist_drive_gain(mode, plug->dsp.band_drive[b] + extra);
+            gain = g > gain ? g : gain;
+        }
+    }
+    else
+    {
+        const int32_t mode = fixed_mode < 0 ? plug->dsp.mode : fixed_mode;
+        gain = c99dist_drive_gain(mode, drive + extra);
+    }
+    return gain > 0.01f ? gain : 0.01f;
+}
+
+// How many sidechain channels to follow this block. 0 when the port is missing or unconnected,
+// when the block is empty, or when the host flags every channel as constant zero.
+C99DIST_INLINE uint32_t c99dist_sidechain_channels(const clap_process_t *process, uint32_t nch)
+{
+    if (process->audio_inputs_count < 2 || !process->audio_inputs[1].data32 ||
+        process->frames_count == 0)
+        return 0;
+    const clap_audio_buffer_t *sc = &process->audio_inputs[1];
+    const uint32_t sc_nch = sc->channel_count < nch ? sc->channel_count : nch;
+    for (uint32_t c = 0; c < sc_nch; c++)
+        if (!(sc->constant_mask & ((uint64_t)1 << c)) || sc->data32[c][0] != 0.f)
+            return sc_nch;
+    return 0;
+}
+
+// The whole audio path. fixed_mode and nch are constants for the variants, which get their own
+// copy of this with the mode switch folded away. fixed_mode < 0 follows the Mode parameter.
+C99DIST_INLINE void c99dist_process_audio(clap_c99_distortion_plug *plug,
+                                          const clap_process_t *process, int32_t fixed_mode,
+                                          uint32_t nch)
+{
+    c99dist_curve_swap(plug);
+    c99dist_params_swap(plug);
+    const float *lut = curve_table(plug->dsp.curve);
+
     const uint32_t nframes = process->frames_count;
+    const uint32_t sc_nch = c99dist_sidechain_channels(process, nch);
     const uint32_t nev = process->in_events->size(process->in_events);
     uint32_t ev_index = 0;
     uint32_t next_ev_frame = nev > 0 ? 0 : nframes;
@@ -566,13 +1735,15 @@ static clap_process_status c99dist_process(const struct clap_plugin *plugin,
         while (ev_index < nev && next_ev_frame == i)
         {
             const clap_event_header_t *hdr = process->in_events->get(process->in_events, ev_index);
-            if (hdr->time != i)
+            // Late events are applied now, ones past the block on its last frame
+            const uint32_t time = hdr->time < nframes ? hdr->time : nframes - 1;
+            if (time > i)
             {
-                next_ev_frame = hdr->time;
+                next_ev_frame = time;
                 break;
             }
 
-            c99dist_process_event(plug, hdr);
+            c99dist_process_event(plug, hdr, process->out_events);
             ++ev_index;
 
             if (ev_index == nev)
@@ -584,58 +1755,166 @@ static clap_process_status c99dist_process(const struct clap_plugin *plugin,
         }
 
         // process every samples until the next event
-        for (; i < next_ev_frame; ++i)
+        if (plug->dsp.filters_dirty)
+            c99dist_update_filters(plug);
+
+        const int32_t mode = fixed_mode < 0 ? plug->dsp.mode : fixed_mode;
+        const int32_t bands = plug->dsp.bands;
+
+        const float drive = plug->dsp.drive + plug->dsp.drive_mod;
+
+        // Output gain and auto gain fold into the mix amounts, so they cost nothing extra.
+        // Auto gain takes back half of the drive boost in dB, which roughly levels the shapers.
+        const float gain = c99dist_drive_gain(mode, drive);
+        const float output = powf(10.f, plug->dsp.output / 20.f);
+        const float comp = plug->dsp.auto_gain ? 1.f / sqrtf(gain > 0.1f ? gain : 0.1f) : 1.f;
+        const float wet = plug->dsp.mix * comp * output;
+        const float dry = (1.f - plug->dsp.mix) * output;
+
+        const uint32_t n = next_ev_frame - i;
+        const float *in[2], *dry_in[2];
+        float *out[2];
+        for (uint32_t c = 0; c < nch; c++)
         {
-            // fetch input samples
-            const float in_l = process->audio_inputs[0].data32[0][i];
-            const float in_r = process->audio_inputs[0].data32[1][i];
-
-            float out_l, out_r;
-            out_l = 0;
-            out_r = 0;
-
-            float tl = in_l * (1.0 + plug->drive);
-            float tr = in_r * (1.0 + plug->drive);
+            in[c] = dry_in[c] = process->audio_inputs[0].data32[c] + i;
+            out[c] = process->audio_outputs[0].data32[c] + i;
+        }
 
-            // Obviously this is inefficient but
-            switch (plug->mode)
-            {
-            case HARD:
+        // The sidechain envelope moves the drive per sample. Once the envelope has released,
+        // an unconnected or silent sidechain skips all of this.
+        const float *env = NULL, *gains = NULL;
+        if (plug->dsp.sidechain != 0.f && (sc_nch > 0 || plug->dsp.follower.env > 0.f))
+        {
+            const float *sc_in[2];
+            for (uint32_t c = 0; c < sc_nch; c++)
+                sc_in[c] = process->audio_inputs[1].data32[c] + i;
+            follower_run(&plug->dsp.follower, sc_nch ? sc_in : NULL, sc_nch, n,
+                         plug->dsp.sidechain_buffer);
+            env = plug->dsp.sidechain_buffer;
+            if (bands == 1)
             {
-                tl = (tl > 1 ? 1 : tl < -1 ? -1 : tl);
-                tr = (tr > 1 ? 1 : tr < -1 ? -1 : tr);
+                float *g = plug->dsp.sidechain_buffer + plug->dsp.max_frames;
+                sidechain_gains(env, g, n, drive, plug->dsp.sidechain,
+                                s_shapers[mode].drive_min, s_shapers[mode].drive_max);
+                gains = g;
             }
-            break;
-            case SOFT:
-            {
-                tl = (tl > 1 ? 1 : tl < -1 ? -1 : tl);
-                tl = 1.5 * tl - 0.5 * tl * tl * tl;
+        }
 
-                tr = (tr > 1 ? 1 : tr < -1 ? -1 : tr);
-                tr = 1.5 * tr - 0.5 * tr * tr * tr;
-            }
-            break;
-            case FOLD:
+        // The fused kernels run the filters around the shaper in one pass. They work across the
+        // channels, so a lone DC blocker isn't worth it: the shaper then runs over consecutive
+        // samples and the blocker after it. Everywhere else the pre filters run first, in place
+        // in out, so the lookahead, the bands and the dry half of the mix all start from the
+        // filtered input, and the post filters run over the mix.
+        const bool lookahead = plug->dsp.lookahead_active;
+        const uint32_t live = plug->dsp.filters.live;
+        const bool fused = (live & ~FILTER_BIT(FILTER_DC_BLOCK)) && !lookahead && bands == 1;
+        if (!fused && (live & FILTER_PRE_STAGES))
+        {
+            filters_pre_run(&plug->dsp.filters, in, out, nch, n);
+            for (uint32_t c = 0; c < nch; c++)
+                in[c] = dry_in[c] = out[c];
+        }
+
+        // The lookahead delays the input and scales it so its peaks reach the shaper at no more
+        // than full scale. The dry half of the mix then comes from the delayed, unscaled copy.
+        if (lookahead)
+        {
+            float *la_dry[2], *la_wet[2];
+            for (uint32_t c = 0; c < nch; c++)
             {
-                tl = sin(2.0 * M_PI * tl);
-                tr = sin(2.0 * M_PI * tr);
+                la_dry[c] = plug->dsp.lookahead_buffer + (size_t)c * plug->dsp.max_frames;
+                la_wet[c] = plug->dsp.lookahead_buffer + (size_t)(2 + c) * plug->dsp.max_frames;
             }
-            break;
+            const float extra = env && plug->dsp.sidechain > 0.f ? plug->dsp.sidechain : 0.f;
+            lookahead_run(&plug->dsp.la, in, la_dry, la_wet, nch, n,
+                          1.f / c99dist_limit_gain(plug, fixed_mode, bands, drive, extra));
+            for (uint32_t c = 0; c < nch; c++)
+            {
+                in[c] = la_wet[c];
+                dry_in[c] = la_dry[c];
             }
-
-            float mix = plug->mix;
-            out_l = mix * tl + (1.0 - mix) * in_l;
-            out_r = mix * tr + (1.0 - mix) * in_r;
-
-            // store output samples
-            process->audio_outputs[0].data32[0][i] = out_l;
-            process->audio_outputs[0].data32[1][i] = out_r;
         }
+
+        const float shaper_dry = lookahead ? 0.f : dry;
+        if (bands > 1)
+            c99dist_process_bands(plug, in, dry_in, out, n, bands, lut, env, fixed_mode, nch);
+        else if (fused && gains)
+            shaper_fused_mod(mode, in, out, nch, n, gains, wet, dry, lut, &plug->dsp.filters);
+        else if (fused)
+            shaper_fused(mode, in, out, nch, n, gain, wet, dry, lut, &plug->dsp.filters);
+        else if (gains)
+            for (uint32_t c = 0; c < nch; c++)
+                shaper_block_mod(mode, in[c], out[c], n, gains, wet, shaper_dry, lut);
+        else
+            for (uint32_t c = 0; c < nch; c++)
+                shaper_block(mode, in[c], out[c], n, gain, wet, shaper_dry, lut);
+
+        if (lookahead && bands == 1)
+            for (uint32_t c = 0; c < nch; c++)
+                lookahead_add_dry(out[c], dry_in[c], n, dry);
+        if (!fused && (live & FILTER_POST_STAGES))
+            filters_post_run(&plug->dsp.filters, out, nch, n);
+        i = next_ev_frame;
     }
 
+    // An empty block still carries its events
+    for (; ev_index < nev; ev_index++)
+        c99dist_process_event(plug, process->in_events->get(process->in_events, ev_index),
+                              process->out_events);
+}
+
+C99DIST_INLINE clap_process_status c99dist_process_with(const struct clap_plugin *plugin,
+                                                       const clap_process_t *process,
+                                                       int32_t fixed_mode, uint32_t nch)
+{
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+
+    // The port layout is fixed and max_frames was set at activation, so this is all the
+    // checking the release path does. Buffers beyond that are validated in debug builds.
+    if (process->audio_inputs_count < 1 || process->audio_outputs_count < 1 ||
+        process->audio_inputs[0].channel_count < nch ||
+        process->audio_outputs[0].channel_count < nch ||
+        process->frames_count > plug->dsp.max_frames)
+        return CLAP_PROCESS_ERROR;
+
+    C99DIST_PROCESS_BEGIN();
+#if C99DIST_VALIDATE
+    // Before flushing, denormal inputs read as zero afterwards
+    c99dist_validate(plug, process, nch);
+#endif
+
+    // Decaying tails in the filters and shapers would otherwise go denormal and stall the FPU.
+    // The host's mode is put back before returning.
+    simd_fp_mode fp_mode = simd_flush_denormals();
+    c99dist_process_audio(plug, process, fixed_mode, nch);
+    simd_restore_fp_mode(fp_mode);
+
+    C99DIST_PROCESS_END();
     return CLAP_PROCESS_CONTINUE;
 }
 
+static clap_process_status c99dist_process(const struct clap_plugin *plugin,
+                                           const clap_process_t *process)
+{
+    return c99dist_process_with(plugin, process, -1, 2);
+}
+
+#define C99DIST_VARIANT_PROCESS(ID, suffix, vname, mode, nch)                                      \
+    static clap_process_status c99dist_process_##ID(const struct clap_plugin *plugin,              \
+                                                    const clap_process_t *process)                 \
+    {                                                                                              \
+        return c99dist_process_with(plugin, process, mode, nch);                                   \
+    }
+C99DIST_VARIANTS(C99DIST_VARIANT_PROCESS)
+
+// The full plugin comes first and keeps its original id
+#define C99DIST_VARIANT_ENTRY(ID, suffix, vname, mode, nch)                                        \
+    {&s_c99dist_desc_##ID, mode, nch, c99dist_process_##ID},
+static const c99dist_variant s_variants[] = {
+    {&s_c99dist_desc, -1, 2, c99dist_process},
+    C99DIST_VARIANTS(C99DIST_VARIANT_ENTRY)
+};
+
 static const void *c99dist_get_extension(const struct clap_plugin *plugin, const char *id)
 {
     if (!strcmp(id, CLAP_EXT_LATENCY))
@@ -646,20 +1925,34 @@ static const void *c99dist_get_extension(const struct clap_plugin *plugin, const
         return &s_c99dist_params;
     if (!strcmp(id, CLAP_EXT_STATE))
         return &s_c99dist_state;
+#if C99DIST_GUI
     if (!strcmp(id, CLAP_EXT_GUI))
         return &s_c99dist_gui;
+#endif
     if (!strcmp(id, CLAP_EXT_TIMER_SUPPORT))
         return &s_c99dist_timer_support;
+    if (!strcmp(id, CLAP_EXT_THREAD_POOL))
+        return &s_c99dist_thread_pool;
+    if (!strcmp(id, CLAP_EXT_PRESET_LOAD) || !strcmp(id, CLAP_EXT_PRESET_LOAD_COMPAT))
+        return &s_c99dist_preset_load;
     return NULL;
 }
 
-static void c99dist_on_main_thread(const struct clap_plugin *plugin) {}
+static void c99dist_on_main_thread(const struct clap_plugin *plugin)
+{
+    clap_c99_distortion_plug *plug = plugin->plugin_data;
+    c99dist_curve_collect(plug);
+    c99dist_params_collect(plug);
+}
 
-clap_plugin_t *c99dist_create(const clap_host_t *host)
+clap_plugin_t *c99dist_create(const clap_host_t *host, const c99dist_variant *variant)
 {
-    clap_c99_distortion_plug *p = calloc(1, sizeof(*p));
+    clap_c99_distortion_plug *p = c99dist_aligned_calloc(sizeof(*p));
+    if (!p)
+        return NULL;
     p->host = host;
-    p->plugin.desc = &s_c99dist_desc;
+    p->variant = variant;
+    p->plugin.desc = variant->desc;
     p->plugin.plugin_data = p;
     p->plugin.init = c99dist_init;
     p->plugin.destroy = c99dist_destroy;
@@ -668,7 +1961,7 @@ clap_plugin_t *c99dist_create(const clap_host_t *host)
     p->plugin.start_processing = c99dist_start_processing;
     p->plugin.stop_processing = c99dist_stop_processing;
     p->plugin.reset = c99dist_reset;
-    p->plugin.process = c99dist_process;
+    p->plugin.process = variant->process;
     p->plugin.get_extension = c99dist_get_extension;
     p->plugin.on_main_thread = c99dist_on_main_thread;
 
@@ -681,26 +1974,17 @@ clap_plugin_t *c99dist_create(const clap_host_t *host)
 // clap_plugin_factory //
 /////////////////////////
 
-static struct
-{
-    const clap_plugin_descriptor_t *desc;
-    clap_plugin_t *(*create)(const clap_host_t *host);
-} s_plugins[] = {
-    {
-        .desc = &s_c99dist_desc,
-        .create = c99dist_create,
-    },
-};
-
 static uint32_t plugin_factory_get_plugin_count(const struct clap_plugin_factory *factory)
 {
-    return sizeof(s_plugins) / sizeof(s_plugins[0]);
+    return sizeof(s_variants) / sizeof(s_variants[0]);
 }
 
 static const clap_plugin_descriptor_t *
 plugin_factory_get_plugin_descriptor(const struct clap_plugin_factory *factory, uint32_t index)
 {
-    return s_plugins[index].desc;
+    if (index >= plugin_factory_get_plugin_count(factory))
+        return NULL;
+    return s_variants[index].desc;
 }
 
 static const clap_plugin_t *plugin_factory_create_plugin(const struct clap_plugin_factory *factory,
@@ -712,10 +1996,10 @@ static const clap_plugin_t *plugin_factory_create_plugin(const struct clap_plugi
         return NULL;
     }
 
-    const int N = sizeof(s_plugins) / sizeof(s_plugins[0]);
+    const int N = sizeof(s_variants) / sizeof(s_variants[0]);
     for (int i = 0; i < N; ++i)
-        if (!strcmp(plugin_id, s_plugins[i].desc->id))
-            return s_plugins[i].create(host);
+        if (!strcmp(plugin_id, s_variants[i].desc->id))
+            return c99dist_create(host, &s_variants[i]);
 
     return NULL;
 }
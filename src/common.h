@@ -5,12 +5,153 @@
 #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+// Windows and macOS have an editor. Other platforms, or any build defining C99DIST_HEADLESS, get
+// the plugin without one, which needs neither nanovg nor a window system.
+#if (defined(_WIN32) || defined(__APPLE__)) && !defined(C99DIST_HEADLESS)
+#define C99DIST_GUI 1
+#else
+#define C99DIST_GUI 0
+#endif
+
 #include <clap/clap.h>
+#if C99DIST_GUI
 #include <nanovg_compat.h>
+#else
+typedef struct NVGcontext NVGcontext;
+#endif
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#define C99DIST_THREAD_LOCAL __declspec(thread)
+#else
+#define C99DIST_THREAD_LOCAL __thread
+#endif
+
+// Debug builds assert that the audio thread never allocates through the wrappers below. The count
+// is raised for the duration of process() and of thread pool tasks, which the audio thread may run
+// itself from inside process(). Heap use anywhere else, libc included, is for the tests to catch
+// (tests/alloc.c). The count is defined once, in clap-c99-distortion.c, so every file sees it.
+#ifndef NDEBUG
+extern C99DIST_THREAD_LOCAL int c99dist_in_process;
+#define C99DIST_PROCESS_BEGIN() (++c99dist_in_process)
+#define C99DIST_PROCESS_END() (--c99dist_in_process)
+#define C99DIST_ASSERT_CAN_ALLOCATE() assert(!c99dist_in_process && "heap use in process()")
+#else
+#define C99DIST_PROCESS_BEGIN() ((void)0)
+#define C99DIST_PROCESS_END() ((void)0)
+#define C99DIST_ASSERT_CAN_ALLOCATE() ((void)0)
+#endif
+
+// Debug builds also check every process() call against the CLAP contract (c99dist_validate).
+// Define C99DIST_VALIDATE to 0 to skip that, or to 1 to keep it in a release build.
+#ifndef C99DIST_VALIDATE
+#ifdef NDEBUG
+#define C99DIST_VALIDATE 0
+#else
+#define C99DIST_VALIDATE 1
+#endif
+#endif
+
+static inline void *c99dist_calloc(size_t count, size_t size)
+{
+    C99DIST_ASSERT_CAN_ALLOCATE();
+    return calloc(count, size);
+}
+static inline void *c99dist_realloc(void *p, size_t size)
+{
+    C99DIST_ASSERT_CAN_ALLOCATE();
+    return realloc(p, size);
+}
+static inline void c99dist_free(void *p)
+{
+    C99DIST_ASSERT_CAN_ALLOCATE();
+    free(p);
+}
+
+#define XARR_REALLOC(ptr, size) c99dist_realloc(ptr, size)
+#define XARR_FREE(ptr) c99dist_free(ptr)
+#include "array.h"
+#include "filters.h"
+#include "crossover.h"
+#include "lookahead.h"
+#include "sidechain.h"
 
 #define GUI_WIDTH 640
 #define GUI_HEIGHT 360
 
+#define C99DIST_CACHE_LINE 64
+
+// C99 has no aligned_alloc, so over-allocate and stash the original pointer just before the
+// aligned block. Memory is zeroed.
+static inline void *c99dist_aligned_calloc(size_t size)
+{
+    void *raw = c99dist_calloc(1, size + C99DIST_CACHE_LINE + sizeof(void *));
+    if (!raw)
+        return NULL;
+    uintptr_t p = ((uintptr_t)raw + sizeof(void *) + C99DIST_CACHE_LINE - 1) &
+                  ~(uintptr_t)(C99DIST_CACHE_LINE - 1);
+    ((void **)p)[-1] = raw;
+    return (void *)p;
+}
+static inline void c99dist_aligned_free(void *p)
+{
+    if (p)
+        c99dist_free(((void **)p)[-1]);
+}
+
+// Pointer handoff between the main and audio threads.
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define c99dist_atomic_xchg(pp, v) _InterlockedExchangePointer((void *volatile *)(pp), (void *)(v))
+#define c99dist_atomic_load(pp)                                                                    \
+    _InterlockedCompareExchangePointer((void *volatile *)(pp), NULL, NULL)
+#define c99dist_atomic_store(pp, v)                                                                \
+    (void)_InterlockedExchangePointer((void *volatile *)(pp), (void *)(v))
+#else
+#define c99dist_atomic_xchg(pp, v) __atomic_exchange_n((pp), (v), __ATOMIC_ACQ_REL)
+#define c99dist_atomic_load(pp) __atomic_load_n((pp), __ATOMIC_ACQUIRE)
+#define c99dist_atomic_store(pp, v) __atomic_store_n((pp), (v), __ATOMIC_RELEASE)
+#endif
+
+struct c99dist_curve;
+
+// Every parameter value as a flat float array, indexed by the sidx_ values below. A loaded state
+// is parsed into one and handed to the audio thread whole. Runs of fields the state chunk stores
+// together (the filters, the output stage, the multiband block) are kept in its order, so they
+// can be read and written in place.
+#define C99DIST_BANDS_STATE_SIZE (1 + MAX_CROSSOVERS + 3 * MAX_BANDS)
+enum
+{
+    sidx_DRIVE,
+    sidx_MIX,
+    sidx_MODE,
+    sidx_LOW_CUT,
+    sidx_EMPHASIS,
+    sidx_HIGH_CUT,
+    sidx_DC_BLOCK,
+    sidx_OUTPUT,
+    sidx_AUTO_GAIN,
+    sidx_LOOKAHEAD,
+    sidx_SIDECHAIN,
+    sidx_BANDS, // bands, crossovers, then mode, drive and mix per band
+    sidx_COUNT = sidx_BANDS + C99DIST_BANDS_STATE_SIZE
+};
+typedef struct
+{
+    float v[sidx_COUNT];
+} c99dist_params_state;
+
+// One entry of the plugin factory, see C99DIST_VARIANTS
+typedef struct
+{
+    const clap_plugin_descriptor_t *desc;
+    int32_t mode;      // the fixed shaper, or -1 when the Mode parameter picks it
+    uint32_t channels; // of the main input and output port
+    clap_process_status (*process)(const clap_plugin_t *plugin, const clap_process_t *process);
+} c99dist_variant;
+
 typedef struct
 {
     void *plug;
@@ -22,21 +163,111 @@ typedef struct
     clap_id draw_timer_ID;
 } clap_c99_gui;
 
+// The band shaping of one block, handed to the host's thread pool by c99dist_process_bands
+typedef struct
+{
+    float *(*bands)[2];
+    const float *lut;
+    const float *env;
+    uint32_t frames;
+} c99dist_band_task;
+
+// Everything process() reads or writes. It sits at the start of the (cache line aligned) plugin
+// struct and is padded to whole cache lines, so it shares none with the handoff pointers or the
+// main thread fields after it. While the plugin is active only the audio thread writes it: loaded
+// state comes through params_pending, and the main thread only touches it in init, activate,
+// deactivate and an inactive flush, which CLAP never runs alongside process().
+//
+// The whole struct is some 1.5 KB. The parameters and pointers every block reads come first and
+// take the first three lines, laid out for 64 bit targets. The filter, crossover, lookahead and
+// follower state after them is far larger and only read by the stages that are switched on.
 typedef struct
 {
+    float drive;
+    float drive_mod; // from PARAM_MOD, cleared by activate and reset
+    float mix;
+    int32_t mode;
+
+    float low_cut;
+    float emphasis;
+    float high_cut;
+    float output; // dB
+
+    bool dc_block;
+    bool auto_gain;
+    bool filters_dirty;   // coefficients are recomputed at the start of the next block
+    bool crossover_dirty; // and so are the crossover's
+
+    // lookahead is the parameter, lookahead_active what this activation runs with. Switching
+    // changes the latency, which only happens through a restart.
+    bool lookahead;
+    bool lookahead_active;
+
+    // Multiband mode, bands == 1 is the plain single band path
+    int32_t bands;
+
+    // Drive added at a full scale sidechain envelope, 0 turns the sidechain off
+    float sidechain;
+
+    // The curve the Curve modes read, owned by the audio thread (see curve_pending below)
+    struct c99dist_curve *curve;
+    double sample_rate;
+
+    float crossover[MAX_CROSSOVERS];
+    int32_t band_mode[MAX_BANDS];
+    float band_drive[MAX_BANDS];
+    float band_mix[MAX_BANDS];
+    uint32_t max_frames;
+
+    float *band_buffer;      // MAX_BANDS * 2 channels * max_frames
+    float *lookahead_buffer; // dry then wet, 2 channels * max_frames each
+    float *sidechain_buffer; // envelope then drive gains per band, max_frames each
+    c99dist_band_task task;
+
+    c99dist_filters filters;
+    c99dist_crossover xover;
+    c99dist_lookahead la;
+    c99dist_follower follower;
+
+#if C99DIST_VALIDATE
+    uint32_t validate_logged; // one bit per problem, each is reported once per activation
+#endif
+} c99dist_dsp;
+
+typedef struct
+{
+    c99dist_dsp dsp;
+    char dsp_pad[C99DIST_CACHE_LINE - sizeof(c99dist_dsp) % C99DIST_CACHE_LINE];
+
+    // New curves are handed to the audio thread through curve_pending and old ones come back
+    // through curve_retired to be freed on the main thread. curve_latest is the newest curve the
+    // main thread published. The parameter values of a loaded state travel the same way through
+    // params_pending and params_retired. Both threads swap these, so they get a line of their own.
+    struct c99dist_curve *curve_pending;
+    struct c99dist_curve *curve_retired;
+    c99dist_params_state *params_pending;
+    c99dist_params_state *params_retired;
+    char handoff_pad[C99DIST_CACHE_LINE - 4 * sizeof(void *)];
+
+    // Main thread only from here, apart from variant which never changes after create
+    struct c99dist_curve *curve_latest;
+    const c99dist_variant *variant;
+
     clap_plugin_t plugin;
     const clap_host_t *host;
     const clap_host_latency_t *hostLatency;
     const clap_host_log_t *hostLog;
     const clap_host_thread_check_t *hostThreadCheck;
+    const clap_host_thread_pool_t *hostThreadPool;
     const clap_host_params_t *hostParams;
     const clap_host_timer_support_t *hostTimerSupport;
+    const clap_host_preset_load_t *hostPresetLoad;
 
     clap_c99_gui *gui;
 
-    float drive;
-    float mix;
-    int32_t mode;
+    // Block sized buffers are carved from this at activate time and released in deactivate
+    void *arena_mem;
+    struct xarena arena;
 } clap_c99_distortion_plug;
 
 float get_pixel_scale(void *window);
@@ -0,0 +1,116 @@
+#pragma once
+// Linkwitz-Riley crossover tree for the multiband mode.
+// Each crossover is a 4th order LR pair (two Butterworth biquads per side). The band below a
+// crossover goes through that crossover's allpass so every band comes out with the same phase
+// and the bands sum back flat. Like filters.h, channels run in the vector lanes.
+#include "filters.h"
+
+#include <string.h>
+
+#define MAX_BANDS 4
+#define MAX_CROSSOVERS (MAX_BANDS - 1)
+
+typedef struct
+{
+    biquad_coefs lp[MAX_CROSSOVERS], hp[MAX_CROSSOVERS], ap[MAX_CROSSOVERS];
+    biquad_state lp_s[MAX_CROSSOVERS][2], hp_s[MAX_CROSSOVERS][2];
+    biquad_state ap_s[MAX_CROSSOVERS][MAX_BANDS]; // [crossover][band below it]
+} c99dist_crossover;
+
+static inline void biquad_allpass(biquad_coefs *c, double freq, double sample_rate)
+{
+    double w0 = 2 * M_PI * freq / sample_rate, cw = cos(w0);
+    double alpha = sin(w0) / (2 * BUTTERWORTH_Q);
+    biquad_set(c, 1 - alpha, -2 * cw, 1 + alpha, 1 + alpha, -2 * cw, 1 - alpha);
+}
+
+static inline void crossover_update(c99dist_crossover *x, const float *freqs, uint32_t num_bands,
+                                    double sample_rate)
+{
+    for (uint32_t k = 0; k + 1 < num_bands; k++)
+    {
+        biquad_lowpass(&x->lp[k], freqs[k], sample_rate);
+        biquad_highpass(&x->hp[k], freqs[k], sample_rate);
+        biquad_allpass(&x->ap[k], freqs[k], sample_rate);
+    }
+}
+
+static inline void crossover_reset(c99dist_crossover *x) { memset(x, 0, sizeof(*x)); }
+
+// Splits in into num_bands bands. bands[b][c] receive n samples.
+static inline void crossover_split(c99dist_crossover *x, const float *const *in, float *(*bands)[2],
+                                   uint32_t nch, uint32_t num_bands, uint32_t n)
+{
+    biquad_vec lp[MAX_CROSSOVERS][2], hp[MAX_CROSSOVERS][2], ap[MAX_CROSSOVERS][MAX_BANDS];
+    for (uint32_t k = 0; k + 1 < num_bands; k++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            lp[k][j] = biquad_vec_load(&x->lp[k], &x->lp_s[k][j]);
+            hp[k][j] = biquad_vec_load(&x->hp[k], &x->hp_s[k][j]);
+        }
+        for (uint32_t b = 0; b < k; b++)
+            ap[k][b] = biquad_vec_load(&x->ap[k], &x->ap_s[k][b]);
+    }
+
+    float frame[VF_WIDTH] = {0};
+    for (uint32_t i = 0; i < n; i++)
+    {
+        for (uint32_t c = 0; c < nch; c++)
+            frame[c] = in[c][i];
+        vf_T rest = vf_load(frame);
+
+        vf_T band[MAX_BANDS];
+        for (uint32_t k = 0; k + 1 < num_bands; k++)
+        {
+            band[k] = biquad_vec_tick(&lp[k][1], biquad_vec_tick(&lp[k][0], rest));
+            rest = biquad_vec_tick(&hp[k][1], biquad_vec_tick(&hp[k][0], rest));
+            for (uint32_t b = 0; b < k; b++)
+                band[b] = biquad_vec_tick(&ap[k][b], band[b]);
+        }
+        band[num_bands - 1] = rest;
+
+        for (uint32_t b = 0; b < num_bands; b++)
+        {
+            vf_store(frame, band[b]);
+            for (uint32_t c = 0; c < nch; c++)
+                bands[b][c][i] = frame[c];
+        }
+    }
+
+    for (uint32_t k = 0; k + 1 < num_bands; k++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            biquad_vec_store(&lp[k][j], &x->lp_s[k][j]);
+            biquad_vec_store(&hp[k][j], &x->hp_s[k][j]);
+        }
+        for (uint32_t b = 0; b < k; b++)
+            biquad_vec_store(&ap[k][b], &x->ap_s[k][b]);
+    }
+}
+
+// Sums the bands and mixes them with the dry input
+static inline void crossover_sum(float *(*bands)[2], const float *const *dry_in, float *const *out,
+                                 uint32_t nch, uint32_t num_bands, uint32_t n, float wet, float dry)
+{
+    const vf_T vwet = vf_set1(wet), vdry = vf_set1(dry);
+    for (uint32_t c = 0; c < nch; c++)
+    {
+        uint32_t i = 0;
+        for (; i + VF_WIDTH <= n; i += VF_WIDTH)
+        {
+            vf_T x = vf_load(bands[0][c] + i);
+            for (uint32_t b = 1; b < num_bands; b++)
+                x = vf_add(x, vf_load(bands[b][c] + i));
+            vf_store(out[c] + i, vf_add(vf_mul(vwet, x), vf_mul(vdry, vf_load(dry_in[c] + i))));
+        }
+        for (; i < n; i++)
+        {
+            float x = bands[0][c][i];
+            for (uint32_t b = 1; b < num_bands; b++)
+                x += bands[b][c][i];
+            out[c][i] = wet * x + dry * dry_in[c][i];
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+// Table driven transfer curve used by the Curve shapers.
+// A curve is a list of (x, y) control points on [-1, 1] which is rendered into a cache line
+// aligned table. The audio thread only ever reads the table; building, loading and freeing all
+// happen on the main thread (see c99dist_curve_publish).
+#include "common.h"
+#include "simd.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CURVE_SIZE 4096
+#define CURVE_PAD 16 // one cache line of guard points on each side of the table
+#define CURVE_MAX_POINTS 256
+
+typedef struct c99dist_curve
+{
+    // Must stay first so the table is cache line aligned
+    float data[CURVE_PAD + CURVE_SIZE + CURVE_PAD];
+
+    uint32_t num_points;
+    float points[CURVE_MAX_POINTS][2];
+} c99dist_curve;
+
+static inline const float *curve_table(const c99dist_curve *c) { return c->data + CURVE_PAD; }
+
+// Table index space position of x, where x is clamped to [-1, 1]
+#define CURVE_POS(P, x)                                                                            \
+    P##mul(P##add(SIMD_CLAMP(P, x, -1.f, 1.f), P##set1(1.f)), P##set1(0.5f * (CURVE_SIZE - 1)))
+
+#define CURVE_LINEAR_BODY(P, table, x)                                                             \
+    P##T f = CURVE_POS(P, x);                                                                      \
+    P##T i = P##floor(f);                                                                          \
+    P##T t = P##sub(f, i);                                                                         \
+    P##T a = P##gather(table, i, 0);                                                               \
+    P##T b = P##gather(table, i, 1);                                                               \
+    return SIMD_FMA(P, t, P##sub(b, a), a);
+
+// Catmull-Rom through table[i - 1] .. table[i + 2]. The guard points make the edges safe.
+#define CURVE_CUBIC_BODY(P, table, x)                                                              \
+    P##T f = CURVE_POS(P, x);                                                                      \
+    P##T i = P##floor(f);                                                                          \
+    P##T t = P##sub(f, i);                                                                         \
+    P##T p0 = P##gather(table, i, -1);                                                             \
+    P##T p1 = P##gather(table, i, 0);                                                              \
+    P##T p2 = P##gather(table, i, 1);                                                              \
+    P##T p3 = P##gather(table, i, 2);                                                              \
+    P##T c3 = P##add(P##mul(P##set1(3.f), P##sub(p1, p2)), P##sub(p3, p0));                        \
+    P##T c2 = P##sub(P##add(P##add(p0, p0), P##mul(P##set1(4.f), p2)),                             \
+                     P##add(P##mul(P##set1(5.f), p1), p3));                                        \
+    P##T c1 = P##sub(p2, p0);                                                                      \
+    P##T c = SIMD_FMA(P, SIMD_FMA(P, c3, t, c2), t, c1);                                           \
+    return SIMD_FMA(P, P##mul(P##set1(0.5f), t), c, p1);
+
+C99DIST_INLINE float sf_curve_linear(const float *table, float x)
+{
+    CURVE_LINEAR_BODY(sf_, table, x)
+}
+C99DIST_INLINE vf_T vf_curve_linear(const float *table, vf_T x)
+{
+    CURVE_LINEAR_BODY(vf_, table, x)
+}
+C99DIST_INLINE float sf_curve_cubic(const float *table, float x)
+{
+    CURVE_CUBIC_BODY(sf_, table, x)
+}
+C99DIST_INLINE vf_T vf_curve_cubic(const float *table, vf_T x)
+{
+    CURVE_CUBIC_BODY(vf_, table, x)
+}
+
+////////////////////////////////
+// main thread only from here //
+////////////////////////////////
+
+// Builds a curve from control points. Points are clamped to [-1, 1] and sorted by x, the table
+// is the piecewise linear interpolation of them and is flat beyond the first and last point.
+// With no points you get the identity, which behaves like the hard clipper.
+static c99dist_curve *curve_create(const float (*points)[2], uint32_t num_points)
+{
+    c99dist_curve *c = c99dist_aligned_calloc(sizeof(c99dist_curve));
+    if (!c)
+        return NULL;
+
+    if (num_points > CURVE_MAX_POINTS)
+        num_points = CURVE_MAX_POINTS;
+    if (num_points == 0)
+    {
+        static const float identity[2][2] = {{-1.f, -1.f}, {1.f, 1.f}};
+        points = identity;
+        num_points = 2;
+    }
+
+    // insertion sort, there are only a handful of points
+    c->num_points = num_points;
+    for (uint32_t i = 0; i < num_points; i++)
+    {
+        float x = points[i][0] < -1.f ? -1.f : points[i][0] > 1.f ? 1.f : points[i][0];
+        float y = points[i][1] < -1.f ? -1.f : points[i][1] > 1.f ? 1.f : points[i][1];
+        uint32_t j = i;
+        for (; j > 0 && c->points[j - 1][0] > x; j--)
+        {
+            c->points[j][0] = c->points[j - 1][0];
+            c->points[j][1] = c->points[j - 1][1];
+        }
+        c->points[j][0] = x;
+        c->points[j][1] = y;
+    }
+
+    float *table = c->data + CURVE_PAD;
+    uint32_t seg = 0;
+    for (uint32_t i = 0; i < CURVE_SIZE; i++)
+    {
+        float x = -1.f + 2.f * (float)i / (CURVE_SIZE - 1);
+        while (seg + 1 < num_points && c->points[seg + 1][0] < x)
+            seg++;
+
+        const float *a = c->points[seg];
+        const float *b = c->points[seg + 1 < num_points ? seg + 1 : seg];
+        if (x <= a[0] || b[0] <= a[0])
+            table[i] = x <= a[0] ? a[1] : b[1];
+        else
+            table[i] = a[1] + (b[1] - a[1]) * (x - a[0]) / (b[0] - a[0]);
+    }
+    for (uint32_t i = 0; i < CURVE_PAD; i++)
+    {
+        c->data[i] = table[0];
+        table[CURVE_SIZE + i] = table[CURVE_SIZE - 1];
+    }
+
+    return c;
+}
+
+static void curve_free(c99dist_curve *c) { c99dist_aligned_free(c); }
+
+// Plain text, one "x y" pair per line. Blank lines and lines starting with # are ignored. NULL
+// when the file can't be read or has no points.
+static c99dist_curve *curve_load_file(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return NULL;
+
+    float points[CURVE_MAX_POINTS][2];
+    uint32_t n = 0;
+    char line[256];
+    while (n < CURVE_MAX_POINTS && fgets(line, sizeof(line), f))
+    {
+        const char *l = line + strspn(line, " \t");
+        if (*l == '#' || *l == '\n' || *l == '\r' || *l == 0)
+            continue;
+        if (sscanf(l, "%f %f", &points[n][0], &points[n][1]) == 2)
+            n++;
+    }
+    fclose(f);
+
+    return n ? curve_create((const float(*)[2])points, n) : NULL;
+}
@@ -0,0 +1,135 @@
+#pragma once
+// Parameter display text.
+// Hosts format and parse parameter values constantly while drawing automation lanes and generic
+// editors, so this avoids printf and strtod: numbers are written from a rounded integer and read
+// digit by digit. Nothing allocates and only plain ASCII is produced or accepted.
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+static char display_lower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+static const char *display_skip_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+// Copies text with its terminator, false if it doesn't fit
+static bool display_copy(char *dst, uint32_t size, const char *text)
+{
+    uint32_t i = 0;
+    for (; text[i]; i++)
+        if (i + 1 >= size)
+            return false;
+    for (uint32_t k = 0; k <= i; k++)
+        dst[k] = text[k];
+    return true;
+}
+
+// value with 0 to 3 decimals and an optional unit after a space, like "-3.5 dB"
+static bool display_format(char *dst, uint32_t size, double value, int decimals,
+                           const char *unit)
+{
+    static const double scale[4] = {1., 10., 100., 1000.};
+    if (!(fabs(value) < 1e15) || decimals < 0 || decimals > 3)
+        return false;
+
+    // Digits go into tmp backwards, least significant first
+    uint64_t q = (uint64_t)(fabs(value) * scale[decimals] + 0.5);
+    const bool neg = value < 0. && q != 0;
+    char tmp[24];
+    int len = 0;
+    for (int d = 0; d < decimals; d++, q /= 10)
+        tmp[len++] = (char)('0' + q % 10);
+    if (decimals)
+        tmp[len++] = '.';
+    do
+    {
+        tmp[len++] = (char)('0' + q % 10);
+        q /= 10;
+    } while (q);
+    if (neg)
+        tmp[len++] = '-';
+
+    uint32_t n = 0;
+    if ((uint32_t)len >= size)
+        return false;
+    while (len)
+        dst[n++] = tmp[--len];
+    if (unit)
+    {
+        if (n + 1 >= size)
+            return false;
+        dst[n++] = ' ';
+        return display_copy(dst + n, size - n, unit);
+    }
+    dst[n] = 0;
+    return true;
+}
+
+// True if text starts with prefix, ignoring case
+static bool display_prefix(const char *text, const char *prefix)
+{
+    for (; *prefix; text++, prefix++)
+        if (display_lower(*text) != display_lower(*prefix))
+            return false;
+    return true;
+}
+
+// True if text is word, ignoring case and surrounding spaces
+static bool display_match(const char *text, const char *word)
+{
+    text = display_skip_space(text);
+    if (!display_prefix(text, word))
+        return false;
+    while (*word++)
+        text++;
+    return *display_skip_space(text) == 0;
+}
+
+// Reads a decimal number from the start of text. *rest is left on whatever follows it.
+static bool display_parse(const char *text, double *value, const char **rest)
+{
+    const char *p = display_skip_space(text);
+    bool neg = false;
+    if (*p == '-' || *p == '+')
+        neg = *p++ == '-';
+
+    double v = 0.;
+    bool digits = false;
+    for (; *p >= '0' && *p <= '9'; p++, digits = true)
+        v = v * 10. + (*p - '0');
+    if (*p == '.')
+    {
+        double place = 0.1;
+        for (p++; *p >= '0' && *p <= '9'; p++, digits = true, place *= 0.1)
+            v += (*p - '0') * place;
+    }
+    if (!digits)
+        return false;
+
+    *value = neg ? -v : v;
+    *rest = p;
+    return true;
+}
+
+// True when what follows a number is nothing or unit, ignoring case and spaces
+static bool display_unit(const char *rest, const char *unit)
+{
+    rest = display_skip_space(rest);
+    return *rest == 0 || display_match(rest, unit);
+}
+
+// Reads a level, a number or -inf followed by nothing or dB. -inf comes back as -HUGE_VAL.
+static bool display_parse_db(const char *text, double *db)
+{
+    const char *rest = display_skip_space(text);
+    if (display_prefix(rest, "-inf"))
+    {
+        *db = -HUGE_VAL;
+        return display_unit(rest + 4, "dB");
+    }
+    return display_parse(text, db, &rest) && display_unit(rest, "dB");
+}
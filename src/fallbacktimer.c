@@ -56,7 +56,7 @@ void fallback_timer_plugin_deinit(const clap_plugin_t *cplug)
         {
             clap_c99_distortion_plug *p = cplug->plugin_data;
             xarr_free(g_plugintimers[i].timers);
-            xarr_delete(g_plugintimers, i);
+            xarr_swap_remove(g_plugintimers, i);
             break;
         }
     }
@@ -98,7 +98,7 @@ void fallback_timer_unregister(const clap_plugin_t *cplug, clap_id timer_id)
     {
         if (pt->timers[i].timer_id == timer_id)
         {
-            xarr_delete(pt->timers, i);
+            xarr_swap_remove(pt->timers, i);
             break;
         }
     }
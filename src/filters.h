@@ -0,0 +1,262 @@
+#pragma once
+// Biquad cascades for the pre/post tone shaping stages.
+// Coefficients are the RBJ cookbook ones. Channels run side by side in the vector lanes, so one
+// tick filters up to VF_WIDTH channels. State lives in plain float arrays so the owning struct
+// needs no special alignment; the kernels keep it in registers for the length of a block.
+#include "simd.h"
+
+#include <stdbool.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#define BUTTERWORTH_Q 0.70710678118654752440
+
+typedef struct
+{
+    float b0, b1, b2, a1, a2;
+} biquad_coefs;
+
+typedef struct
+{
+    float z1[VF_WIDTH];
+    float z2[VF_WIDTH];
+} biquad_state;
+
+// pre: low cut, emphasis. post: de-emphasis, high cut, dc blocker. The pre stages filter the
+// input before it splits into dry and wet, the post stages filter the mix, so the whole output
+// is tone shaped whatever the mix.
+enum FilterStage
+{
+    FILTER_LOW_CUT,
+    FILTER_EMPHASIS,
+    FILTER_DEEMPHASIS,
+    FILTER_HIGH_CUT,
+    FILTER_DC_BLOCK,
+    FILTER_STAGE_COUNT
+};
+
+#define FILTER_BIT(stage) (1u << (stage))
+#define FILTER_PRE_STAGES (FILTER_BIT(FILTER_LOW_CUT) | FILTER_BIT(FILTER_EMPHASIS))
+#define FILTER_POST_STAGES                                                                         \
+    (FILTER_BIT(FILTER_DEEMPHASIS) | FILTER_BIT(FILTER_HIGH_CUT) | FILTER_BIT(FILTER_DC_BLOCK))
+
+typedef struct
+{
+    biquad_coefs c[FILTER_STAGE_COUNT];
+    biquad_state s[FILTER_STAGE_COUNT];
+    uint32_t live; // FILTER_BIT of every stage that isn't a pass through, the rest are skipped
+} c99dist_filters;
+
+static inline void biquad_set(biquad_coefs *c, double b0, double b1, double b2, double a0,
+                              double a1, double a2)
+{
+    c->b0 = (float)(b0 / a0);
+    c->b1 = (float)(b1 / a0);
+    c->b2 = (float)(b2 / a0);
+    c->a1 = (float)(a1 / a0);
+    c->a2 = (float)(a2 / a0);
+}
+
+static inline void biquad_identity(biquad_coefs *c) { biquad_set(c, 1, 0, 0, 1, 0, 0); }
+
+static inline void biquad_highpass(biquad_coefs *c, double freq, double sample_rate)
+{
+    double w0 = 2 * M_PI * freq / sample_rate, cw = cos(w0);
+    double alpha = sin(w0) / (2 * BUTTERWORTH_Q);
+    biquad_set(c, (1 + cw) / 2, -(1 + cw), (1 + cw) / 2, 1 + alpha, -2 * cw, 1 - alpha);
+}
+
+static inline void biquad_lowpass(biquad_coefs *c, double freq, double sample_rate)
+{
+    double w0 = 2 * M_PI * freq / sample_rate, cw = cos(w0);
+    double alpha = sin(w0) / (2 * BUTTERWORTH_Q);
+    biquad_set(c, (1 - cw) / 2, 1 - cw, (1 - cw) / 2, 1 + alpha, -2 * cw, 1 - alpha);
+}
+
+// A high shelf at freq scaled down by half its gain, so lows drop by db/2 and highs rise by db/2.
+// tilt(-db) undoes tilt(db).
+static inline void biquad_tilt(biquad_coefs *c, double db, double freq, double sample_rate)
+{
+    double A = pow(10, db / 40), sA = sqrt(A);
+    double w0 = 2 * M_PI * freq / sample_rate, cw = cos(w0), alpha = sin(w0) / 2 * sqrt(2.0);
+    double b0 = A * ((A + 1) + (A - 1) * cw + 2 * sA * alpha);
+    double b1 = -2 * A * ((A - 1) + (A + 1) * cw);
+    double b2 = A * ((A + 1) + (A - 1) * cw - 2 * sA * alpha);
+    double a0 = (A + 1) - (A - 1) * cw + 2 * sA * alpha;
+    double a1 = 2 * ((A - 1) - (A + 1) * cw);
+    double a2 = (A + 1) - (A - 1) * cw - 2 * sA * alpha;
+    biquad_set(c, b0 / A, b1 / A, b2 / A, a0, a1, a2);
+}
+
+// One pole, one zero high-pass: y = x - x1 + R * y1, scaled for unity gain at Nyquist
+static inline void biquad_dc_block(biquad_coefs *c, double freq, double sample_rate)
+{
+    double R = exp(-2 * M_PI * freq / sample_rate), g = (1 + R) / 2;
+    biquad_set(c, g, -g, 0, 1, -R, 0);
+}
+
+static inline void filters_reset(c99dist_filters *f)
+{
+    for (int k = 0; k < FILTER_STAGE_COUNT; k++)
+        for (int j = 0; j < VF_WIDTH; j++)
+            f->s[k].z1[j] = f->s[k].z2[j] = 0.f;
+}
+
+// Sets the live stages. A stage coming back on starts from silence, stale state from the last
+// time it ran would click.
+static inline void filters_set_live(c99dist_filters *f, uint32_t live)
+{
+    for (int k = 0; k < FILTER_STAGE_COUNT; k++)
+        if ((live & FILTER_BIT(k)) && !(f->live & FILTER_BIT(k)))
+            for (int j = 0; j < VF_WIDTH; j++)
+                f->s[k].z1[j] = f->s[k].z2[j] = 0.f;
+    f->live = live;
+}
+
+// Register copy of one stage, loaded before and stored after a block loop
+typedef struct
+{
+    vf_T b0, b1, b2, a1, a2, z1, z2;
+} biquad_vec;
+
+C99DIST_INLINE biquad_vec biquad_vec_load(const biquad_coefs *c, const biquad_state *s)
+{
+    biquad_vec v = {vf_set1(c->b0), vf_set1(c->b1), vf_set1(c->b2), vf_set1(c->a1),
+                    vf_set1(c->a2), vf_load(s->z1), vf_load(s->z2)};
+    return v;
+}
+
+// Below this the state is inaudible, it is stored as zero so a decaying tail can't go denormal
+// on hosts or platforms where flush to zero isn't in effect
+#define BIQUAD_STATE_FLOOR 1e-15f
+
+C99DIST_INLINE vf_T biquad_flush(vf_T z)
+{
+    return vf_select(vf_lt(vf_abs(z), vf_set1(BIQUAD_STATE_FLOOR)), vf_set1(0.f), z);
+}
+
+C99DIST_INLINE void biquad_vec_store(const biquad_vec *v, biquad_state *s)
+{
+    vf_store(s->z1, biquad_flush(v->z1));
+    vf_store(s->z2, biquad_flush(v->z2));
+}
+
+// Transposed direct form II
+C99DIST_INLINE vf_T biquad_vec_tick(biquad_vec *v, vf_T x)
+{
+    vf_T y = SIMD_FMA(vf_, v->b0, x, v->z1);
+    v->z1 = vf_sub(SIMD_FMA(vf_, v->b1, x, v->z2), vf_mul(v->a1, y));
+    v->z2 = vf_sub(vf_mul(v->b2, x), vf_mul(v->a2, y));
+    return y;
+}
+
+// Pre stages, low cut then emphasis, from in to out. in may be out. Only the live stages run.
+static inline void filters_pre_run(c99dist_filters *f, const float *const *in, float *const *out,
+                                   uint32_t nch, uint32_t n)
+{
+    const bool low_on = f->live & FILTER_BIT(FILTER_LOW_CUT);
+    const bool emph_on = f->live & FILTER_BIT(FILTER_EMPHASIS);
+    biquad_vec low = biquad_vec_load(&f->c[FILTER_LOW_CUT], &f->s[FILTER_LOW_CUT]);
+    biquad_vec emph = biquad_vec_load(&f->c[FILTER_EMPHASIS], &f->s[FILTER_EMPHASIS]);
+
+    float frame[VF_WIDTH] = {0};
+    for (uint32_t i = 0; i < n; i++)
+    {
+        for (uint32_t c = 0; c < nch; c++)
+            frame[c] = in[c][i];
+        vf_T x = vf_load(frame);
+        if (low_on)
+            x = biquad_vec_tick(&low, x);
+        if (emph_on)
+            x = biquad_vec_tick(&emph, x);
+        vf_store(frame, x);
+        for (uint32_t c = 0; c < nch; c++)
+            out[c][i] = frame[c];
+    }
+
+    biquad_vec_store(&low, &f->s[FILTER_LOW_CUT]);
+    biquad_vec_store(&emph, &f->s[FILTER_EMPHASIS]);
+}
+
+// The DC blocker on its own. It is a one pole filter, so it can step four samples at a time
+// over each channel instead of moving the signal into the vector lanes. With a = -a1 and
+// bz = b1 - a1 * b0 the state obeys z' = a * z + bz * x and y = b0 * x + z, so across four
+// samples z picks up powers of a and the recursion is one multiply add per four samples.
+static inline void filters_dc_run(c99dist_filters *f, float *const *io, uint32_t nch, uint32_t n)
+{
+    const biquad_coefs *k = &f->c[FILTER_DC_BLOCK];
+    const float b0 = k->b0, a = -k->a1, bz = k->b1 - k->a1 * k->b0;
+    const float a2 = a * a, a3 = a2 * a, a4 = a2 * a2;
+
+    // y[j] = b0 * x[j] + p[j] * z + sum over m < j of bz * a^(j - 1 - m) * x[m]
+    const float p[VF_WIDTH] = {1.f, a, a2, a3};
+    const float u0[VF_WIDTH] = {0.f, bz, bz * a, bz * a2};
+    const float u1[VF_WIDTH] = {0.f, 0.f, bz, bz * a};
+    const float u2[VF_WIDTH] = {0.f, 0.f, 0.f, bz};
+    const vf_T vb0 = vf_set1(b0), vp = vf_load(p), vu0 = vf_load(u0), vu1 = vf_load(u1),
+               vu2 = vf_load(u2);
+
+    float *z1 = f->s[FILTER_DC_BLOCK].z1;
+    for (uint32_t c = 0; c < nch; c++)
+    {
+        float *x = io[c], z = z1[c];
+        uint32_t i = 0;
+        for (; i + VF_WIDTH <= n; i += VF_WIDTH)
+        {
+            const float x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+            vf_T y = SIMD_FMA(vf_, vb0, vf_load(x + i), vf_mul(vp, vf_set1(z)));
+            y = SIMD_FMA(vf_, vu0, vf_set1(x0), y);
+            y = SIMD_FMA(vf_, vu1, vf_set1(x1), y);
+            y = SIMD_FMA(vf_, vu2, vf_set1(x2), y);
+            vf_store(x + i, y);
+            z = a4 * z + bz * (((a * x0 + x1) * a + x2) * a + x3);
+        }
+        for (; i < n; i++)
+        {
+            const float xi = x[i];
+            x[i] = b0 * xi + z;
+            z = a * z + bz * xi;
+        }
+        z1[c] = fabsf(z) < BIQUAD_STATE_FLOOR ? 0.f : z;
+    }
+}
+
+// Post stages, de-emphasis, high cut then the DC blocker, in place on the mixed signal. Only the
+// live stages run.
+static inline void filters_post_run(c99dist_filters *f, float *const *io, uint32_t nch, uint32_t n)
+{
+    if ((f->live & FILTER_POST_STAGES) == FILTER_BIT(FILTER_DC_BLOCK))
+    {
+        filters_dc_run(f, io, nch, n);
+        return;
+    }
+
+    const bool deemph_on = f->live & FILTER_BIT(FILTER_DEEMPHASIS);
+    const bool high_on = f->live & FILTER_BIT(FILTER_HIGH_CUT);
+    const bool dc_on = f->live & FILTER_BIT(FILTER_DC_BLOCK);
+    biquad_vec deemph = biquad_vec_load(&f->c[FILTER_DEEMPHASIS], &f->s[FILTER_DEEMPHASIS]);
+    biquad_vec high = biquad_vec_load(&f->c[FILTER_HIGH_CUT], &f->s[FILTER_HIGH_CUT]);
+    biquad_vec dc = biquad_vec_load(&f->c[FILTER_DC_BLOCK], &f->s[FILTER_DC_BLOCK]);
+
+    float frame[VF_WIDTH] = {0};
+    for (uint32_t i = 0; i < n; i++)
+    {
+        for (uint32_t c = 0; c < nch; c++)
+            frame[c] = io[c][i];
+        vf_T x = vf_load(frame);
+        if (deemph_on)
+            x = biquad_vec_tick(&deemph, x);
+        if (high_on)
+            x = biquad_vec_tick(&high, x);
+        if (dc_on)
+            x = biquad_vec_tick(&dc, x);
+        vf_store(frame, x);
+        for (uint32_t c = 0; c < nch; c++)
+            io[c][i] = frame[c];
+    }
+
+    biquad_vec_store(&deemph, &f->s[FILTER_DEEMPHASIS]);
+    biquad_vec_store(&high, &f->s[FILTER_HIGH_CUT]);
+    biquad_vec_store(&dc, &f->s[FILTER_DC_BLOCK]);
+}
@@ -0,0 +1,130 @@
+#pragma once
+// Lookahead drive limiter.
+// The input is delayed by `length` samples while a sliding window max over the undelayed input
+// tells us the loudest peak that is about to come out. The delayed signal is scaled down so that
+// peak reaches the shaper at no more than the limit, with the gain already ramped down by the
+// time the peak arrives. The window max is a monotonic deque: every sample is pushed and popped
+// at most once, so the cost per sample is constant whatever the window length.
+// All memory is handed in by the caller (see c99dist_activate), channels run in the vector lanes.
+#include "simd.h"
+
+#include <math.h>
+#include <string.h>
+
+#define LOOKAHEAD_MS 3.0
+#define LOOKAHEAD_RELEASE_MS 60.0
+
+typedef struct
+{
+    uint32_t length; // samples of lookahead, which is also the latency
+    uint32_t mask;   // ring sizes are mask + 1, a power of two above length
+    uint32_t pos;    // running sample counter, wraps
+
+    float (*delay)[VF_WIDTH]; // delayed frames
+    uint32_t *dq_pos;         // deque of (sample counter, peak) with decreasing peaks
+    float *dq_peak;
+    uint32_t dq_head, dq_tail;
+
+    float env; // gain currently applied to the delayed signal, 1 is no reduction
+    float attack, release;
+} c99dist_lookahead;
+
+static inline uint32_t lookahead_length(double sample_rate)
+{
+    return (uint32_t)(LOOKAHEAD_MS * 0.001 * sample_rate + 0.5);
+}
+
+// Elements in each of the rings lookahead_init takes
+static inline uint32_t lookahead_ring_size(uint32_t length)
+{
+    uint32_t size = 1;
+    while (size <= length)
+        size <<= 1;
+    return size;
+}
+
+static inline void lookahead_reset(c99dist_lookahead *la)
+{
+    memset(la->delay, 0, sizeof(*la->delay) * (la->mask + 1));
+    la->pos = la->dq_head = la->dq_tail = 0;
+    la->env = 1.f;
+}
+
+// The three arrays need lookahead_ring_size(length) elements each
+static inline void lookahead_init(c99dist_lookahead *la, uint32_t length, double sample_rate,
+                                  float (*delay)[VF_WIDTH], uint32_t *dq_pos, float *dq_peak)
+{
+    la->length = length;
+    la->mask = lookahead_ring_size(length) - 1;
+    la->delay = delay;
+    la->dq_pos = dq_pos;
+    la->dq_peak = dq_peak;
+
+    // The attack settles to within 1% over the lookahead, so peaks arrive fully reduced
+    la->attack = length ? 1.f - expf(-5.f / length) : 1.f;
+    la->release = 1.f - (float)exp(-1000.0 / (LOOKAHEAD_RELEASE_MS * sample_rate));
+    lookahead_reset(la);
+}
+
+// Delays nch channels of in by la->length into dry, and writes the same signal scaled so no
+// sample exceeds limit into wet
+static inline void lookahead_run(c99dist_lookahead *la, const float *const *in, float *const *dry,
+                                 float *const *wet, uint32_t nch, uint32_t n, float limit)
+{
+    const uint32_t mask = la->mask, length = la->length;
+    uint32_t pos = la->pos, head = la->dq_head, tail = la->dq_tail;
+    float env = la->env;
+
+    float frame[VF_WIDTH] = {0};
+    for (uint32_t i = 0; i < n; i++, pos++)
+    {
+        for (uint32_t c = 0; c < nch; c++)
+            frame[c] = in[c][i];
+        vf_T x = vf_load(frame);
+        vf_store(la->delay[pos & mask], x);
+
+        // Peak of this frame across channels
+        vf_store(frame, vf_abs(x));
+        float peak = frame[0];
+        for (uint32_t c = 1; c < nch; c++)
+            peak = frame[c] > peak ? frame[c] : peak;
+
+        // Drop what left the window and what the new peak dominates. That leaves at most
+        // length + 1 entries, which always fit the ring.
+        while (tail != head && pos - la->dq_pos[head & mask] > length)
+            head++;
+        while (tail != head && la->dq_peak[(tail - 1) & mask] <= peak)
+            tail--;
+        la->dq_pos[tail & mask] = pos;
+        la->dq_peak[tail & mask] = peak;
+        tail++;
+
+        const float window_peak = la->dq_peak[head & mask];
+        const float target = window_peak > limit ? limit / window_peak : 1.f;
+        env += (target < env ? la->attack : la->release) * (target - env);
+
+        vf_T d = vf_load(la->delay[(pos - length) & mask]);
+        vf_store(frame, d);
+        for (uint32_t c = 0; c < nch; c++)
+            dry[c][i] = frame[c];
+        vf_store(frame, vf_mul(d, vf_set1(env)));
+        for (uint32_t c = 0; c < nch; c++)
+            wet[c][i] = frame[c];
+    }
+
+    la->pos = pos;
+    la->dq_head = head;
+    la->dq_tail = tail;
+    la->env = env;
+}
+
+// out += amount * dry, for the dry half of the mix once the wet path has run on the scaled signal
+static inline void lookahead_add_dry(float *out, const float *dry, uint32_t n, float amount)
+{
+    const vf_T a = vf_set1(amount);
+    uint32_t i = 0;
+    for (; i + VF_WIDTH <= n; i += VF_WIDTH)
+        vf_store(out + i, SIMD_FMA(vf_, a, vf_load(dry + i), vf_load(out + i)));
+    for (; i < n; i++)
+        out[i] += amount * dry[i];
+}
@@ -0,0 +1,251 @@
+#pragma once
+// Waveshaper registry.
+// Each algorithm is described once in C99DIST_SHAPERS below. From that single line we generate the
+// ClipType enum, the scalar and 4-lane kernels, a vectorised block kernel and the s_shapers table
+// used for the parameter range and display text.
+#include "simd.h"
+#include "curve.h"
+#include "filters.h"
+
+// X(ID, display name, drive min, drive max, kernel body)
+// Append new shapers at the end, the ClipType values are saved in the plugin state.
+// clang-format off
+#define C99DIST_SHAPERS(X)                                                                         \
+    X(HARD,      "Hard Clip",          -1.f, 6.f, SHAPER_BODY_HARD)                                \
+    X(SOFT,      "Soft Clip (Tanh)",   -1.f, 6.f, SHAPER_BODY_SOFT)                                \
+    X(FOLD,      "Simple Folder",      -1.f, 6.f, SHAPER_BODY_FOLD)                                \
+    X(TUBE,      "Asymmetric Tube",    -1.f, 6.f, SHAPER_BODY_TUBE)                                \
+    X(ATAN,      "Arctan",             -1.f, 6.f, SHAPER_BODY_ATAN)                                \
+    X(DIODE,     "Diode",              -1.f, 6.f, SHAPER_BODY_DIODE)                               \
+    X(CRUSH,     "Bit Crush",          -1.f, 6.f, SHAPER_BODY_CRUSH)                               \
+    X(MULTIFOLD, "Multi-stage Folder", -1.f, 3.f, SHAPER_BODY_MULTIFOLD)                           \
+    X(CURVE_LINEAR, "Curve (Linear)",  -1.f, 6.f, SHAPER_BODY_CURVE_LINEAR)                        \
+    X(CURVE_CUBIC,  "Curve (Cubic)",   -1.f, 6.f, SHAPER_BODY_CURVE_CUBIC)
+// clang-format on
+
+// Kernel bodies are written against the P##op scheme from simd.h so the same text expands to
+// sf_ (one float) and vf_ (four floats). x is the input after drive gain has been applied and
+// lut is the current curve table (see curve.h), which only the Curve shapers look at.
+
+#define SHAPER_BODY_HARD(P, x) return SIMD_CLAMP(P, x, -1.f, 1.f);
+
+// Cubic soft clip: 1.5x - 0.5x^3 on [-1, 1]
+#define SHAPER_CUBIC(P, c) P##mul(c, P##sub(P##set1(1.5f), P##mul(P##set1(0.5f), P##mul(c, c))))
+#define SHAPER_BODY_SOFT(P, x)                                                                     \
+    P##T c = SIMD_CLAMP(P, x, -1.f, 1.f);                                                          \
+    return SHAPER_CUBIC(P, c);
+
+#define SHAPER_BODY_FOLD(P, x) return P##sin2pi(x);
+
+// The cubic clipper biased by a quarter, so the positive half saturates first like a single
+// ended triode stage. The static offset is removed but the signal-dependent DC is kept.
+#define SHAPER_BODY_TUBE(P, x)                                                                     \
+    P##T c = SIMD_CLAMP(P, P##add(x, P##set1(0.25f)), -1.f, 1.f);                                  \
+    return P##sub(SHAPER_CUBIC(P, c), P##set1(0.3671875f));
+
+#define SHAPER_BODY_ATAN(P, x) return P##mul(P##atan(x), P##set1(0.636619772367581343f));
+
+// x / (1 + k|x|), with a harder knee on the conducting (positive) side
+#define SHAPER_BODY_DIODE(P, x)                                                                    \
+    P##T k = P##select(P##gt(x, P##set1(0.f)), P##set1(3.f), P##set1(1.f));                        \
+    return P##div(x, SIMD_FMA(P, k, P##abs(x), P##set1(1.f)));
+
+// 4 bit quantiser
+#define SHAPER_BODY_CRUSH(P, x)                                                                    \
+    P##T c = SIMD_CLAMP(P, x, -1.f, 1.f);                                                          \
+    return P##mul(P##round(P##mul(c, P##set1(8.f))), P##set1(0.125f));
+
+// Triangle folder reflecting at +-1, run twice with a 2x gain between stages
+#define SHAPER_TRIFOLD(P, x, u)                                                                    \
+    u = SIMD_FMA(P, x, P##set1(0.25f), P##set1(0.25f));                                            \
+    u = SIMD_FMA(P, P##abs(P##sub(u, P##round(u))), P##set1(4.f), P##set1(-1.f));
+#define SHAPER_BODY_MULTIFOLD(P, x)                                                                \
+    P##T u;                                                                                        \
+    SHAPER_TRIFOLD(P, x, u)                                                                        \
+    u = P##mul(u, P##set1(2.f));                                                                   \
+    SHAPER_TRIFOLD(P, u, u)                                                                        \
+    return u;
+
+#define SHAPER_BODY_CURVE_LINEAR(P, x) return P##curve_linear(lut, x);
+#define SHAPER_BODY_CURVE_CUBIC(P, x) return P##curve_cubic(lut, x);
+
+// Generates shaper_<ID>_1, shaper_<ID>_4 and the block kernels shaper_<ID>_block and _block_mod.
+// The block kernel applies the drive gain, the shaper and the dry/wet mix in one pass. wet and dry
+// are the mix amounts with any output gain already folded in. _block_mod takes a drive gain per
+// sample instead, for the sidechain.
+#define SHAPER_DEFINE_KERNELS(ID, name, dmin, dmax, body)                                          \
+    C99DIST_INLINE float shaper_##ID##_1(float x, const float *lut) { body(sf_, x) }               \
+    C99DIST_INLINE vf_T shaper_##ID##_4(vf_T x, const float *lut) { body(vf_, x) }                 \
+    static void shaper_##ID##_block(const float *in, float *out, uint32_t n, float gain,           \
+                                    float wet, float dry, const float *lut)                        \
+    {                                                                                              \
+        const vf_T vgain = vf_set1(gain), vwet = vf_set1(wet), vdry = vf_set1(dry);                \
+        uint32_t i = 0;                                                                            \
+        for (; i + VF_WIDTH <= n; i += VF_WIDTH)                                                   \
+        {                                                                                          \
+            vf_T x = vf_load(in + i);                                                              \
+            vf_T y = shaper_##ID##_4(vf_mul(x, vgain), lut);                                       \
+            vf_store(out + i, vf_add(vf_mul(vwet, y), vf_mul(vdry, x)));                           \
+        }                                                                                          \
+        for (; i < n; i++)                                                                         \
+            out[i] = wet * shaper_##ID##_1(in[i] * gain, lut) + dry * in[i];                       \
+    }                                                                                              \
+    static void shaper_##ID##_block_mod(const float *in, float *out, uint32_t n,                   \
+                                        const float *gains, float wet, float dry,                  \
+                                        const float *lut)                                          \
+    {                                                                                              \
+        const vf_T vwet = vf_set1(wet), vdry = vf_set1(dry);                                       \
+        uint32_t i = 0;                                                                            \
+        for (; i + VF_WIDTH <= n; i += VF_WIDTH)                                                   \
+        {                                                                                          \
+            vf_T x = vf_load(in + i);                                                              \
+            vf_T y = shaper_##ID##_4(vf_mul(x, vf_load(gains + i)), lut);                          \
+            vf_store(out + i, vf_add(vf_mul(vwet, y), vf_mul(vdry, x)));                           \
+        }                                                                                          \
+        for (; i < n; i++)                                                                         \
+            out[i] = wet * shaper_##ID##_1(in[i] * gains[i], lut) + dry * in[i];                   \
+    }
+C99DIST_SHAPERS(SHAPER_DEFINE_KERNELS)
+
+typedef vf_T (*shaper_vec_fn)(vf_T x, const float *lut);
+
+// Pre filters, drive, shaper, mix, then post filters and DC blocker in a single pass over the
+// block. The dry half of the mix is taken after the pre filters and the post filters run on the
+// mix, so the filters shape the whole output rather than only the wet part. The biquads are
+// recursive, so here the channels go in the vector lanes rather than consecutive samples. Stages
+// that aren't live are skipped, the branches go the same way for the whole block. gains, when
+// not NULL, replaces gain with one value per sample.
+C99DIST_INLINE void shaper_fused_run(shaper_vec_fn shape, const float *const *in,
+                                     float *const *out, uint32_t nch, uint32_t n, float gain,
+                                     const float *gains, float wet, float dry, const float *lut,
+                                     c99dist_filters *f)
+{
+    const bool low_on = f->live & FILTER_BIT(FILTER_LOW_CUT);
+    const bool emph_on = f->live & FILTER_BIT(FILTER_EMPHASIS);
+    const bool high_on = f->live & FILTER_BIT(FILTER_HIGH_CUT);
+    const bool dc_on = f->live & FILTER_BIT(FILTER_DC_BLOCK);
+    biquad_vec low = biquad_vec_load(&f->c[FILTER_LOW_CUT], &f->s[FILTER_LOW_CUT]);
+    biquad_vec emph = biquad_vec_load(&f->c[FILTER_EMPHASIS], &f->s[FILTER_EMPHASIS]);
+    biquad_vec deemph = biquad_vec_load(&f->c[FILTER_DEEMPHASIS], &f->s[FILTER_DEEMPHASIS]);
+    biquad_vec high = biquad_vec_load(&f->c[FILTER_HIGH_CUT], &f->s[FILTER_HIGH_CUT]);
+    biquad_vec dc = biquad_vec_load(&f->c[FILTER_DC_BLOCK], &f->s[FILTER_DC_BLOCK]);
+    const vf_T vgain = vf_set1(gain), vwet = vf_set1(wet), vdry = vf_set1(dry);
+
+    float frame[VF_WIDTH] = {0};
+    for (uint32_t i = 0; i < n; i++)
+    {
+        for (uint32_t c = 0; c < nch; c++)
+            frame[c] = in[c][i];
+
+        vf_T x = vf_load(frame);
+        if (low_on)
+            x = biquad_vec_tick(&low, x);
+        if (emph_on)
+            x = biquad_vec_tick(&emph, x);
+        vf_T y = shape(vf_mul(x, gains ? vf_set1(gains[i]) : vgain), lut);
+        y = vf_add(vf_mul(vwet, y), vf_mul(vdry, x));
+        if (emph_on)
+            y = biquad_vec_tick(&deemph, y);
+        if (high_on)
+            y = biquad_vec_tick(&high, y);
+        if (dc_on)
+            y = biquad_vec_tick(&dc, y);
+
+        vf_store(frame, y);
+        for (uint32_t c = 0; c < nch; c++)
+            out[c][i] = frame[c];
+    }
+
+    biquad_vec_store(&low, &f->s[FILTER_LOW_CUT]);
+    biquad_vec_store(&emph, &f->s[FILTER_EMPHASIS]);
+    biquad_vec_store(&deemph, &f->s[FILTER_DEEMPHASIS]);
+    biquad_vec_store(&high, &f->s[FILTER_HIGH_CUT]);
+    biquad_vec_store(&dc, &f->s[FILTER_DC_BLOCK]);
+}
+
+#define SHAPER_DEFINE_FUSED(ID, name, dmin, dmax, body)                                            \
+    static void shaper_##ID##_fused(const float *const *in, float *const *out, uint32_t nch,       \
+                                    uint32_t n, float gain, float wet, float dry,                  \
+                                    const float *lut, c99dist_filters *f)                          \
+    {                                                                                              \
+        shaper_fused_run(shaper_##ID##_4, in, out, nch, n, gain, NULL, wet, dry, lut, f);          \
+    }                                                                                              \
+    static void shaper_##ID##_fused_mod(const float *const *in, float *const *out, uint32_t nch,   \
+                                        uint32_t n, const float *gains, float wet, float dry,      \
+                                        const float *lut, c99dist_filters *f)                      \
+    {                                                                                              \
+        shaper_fused_run(shaper_##ID##_4, in, out, nch, n, 0.f, gains, wet, dry, lut, f);          \
+    }
+C99DIST_SHAPERS(SHAPER_DEFINE_FUSED)
+
+#define SHAPER_ENUM(ID, name, dmin, dmax, body) ID,
+enum ClipType
+{
+    C99DIST_SHAPERS(SHAPER_ENUM) CLIP_TYPE_COUNT
+};
+
+typedef struct
+{
+    const char *name;
+    float drive_min;
+    float drive_max;
+} c99dist_shaper;
+
+#define SHAPER_TABLE(ID, name, dmin, dmax, body) {name, dmin, dmax},
+static const c99dist_shaper s_shapers[CLIP_TYPE_COUNT] = {C99DIST_SHAPERS(SHAPER_TABLE)};
+
+// Run the kernels for a mode through a switch generated from the registry. When mode is a
+// constant at the call site, as in the fixed variants, the switch folds into a direct call.
+#define SHAPER_CASE_BLOCK(ID, name, dmin, dmax, body)                                              \
+    case ID:                                                                                       \
+        shaper_##ID##_block(in, out, n, gain, wet, dry, lut);                                      \
+        break;
+C99DIST_INLINE void shaper_block(int32_t mode, const float *in, float *out, uint32_t n,
+                                 float gain, float wet, float dry, const float *lut)
+{
+    switch (mode)
+    {
+        C99DIST_SHAPERS(SHAPER_CASE_BLOCK)
+    }
+}
+
+#define SHAPER_CASE_FUSED(ID, name, dmin, dmax, body)                                              \
+    case ID:                                                                                       \
+        shaper_##ID##_fused(in, out, nch, n, gain, wet, dry, lut, f);                              \
+        break;
+C99DIST_INLINE void shaper_fused(int32_t mode, const float *const *in, float *const *out,
+                                 uint32_t nch, uint32_t n, float gain, float wet, float dry,
+                                 const float *lut, c99dist_filters *f)
+{
+    switch (mode)
+    {
+        C99DIST_SHAPERS(SHAPER_CASE_FUSED)
+    }
+}
+
+#define SHAPER_CASE_BLOCK_MOD(ID, name, dmin, dmax, body)                                          \
+    case ID:                                                                                       \
+        shaper_##ID##_block_mod(in, out, n, gains, wet, dry, lut);                                 \
+        break;
+C99DIST_INLINE void shaper_block_mod(int32_t mode, const float *in, float *out, uint32_t n,
+                                     const float *gains, float wet, float dry, const float *lut)
+{
+    switch (mode)
+    {
+        C99DIST_SHAPERS(SHAPER_CASE_BLOCK_MOD)
+    }
+}
+
+#define SHAPER_CASE_FUSED_MOD(ID, name, dmin, dmax, body)                                          \
+    case ID:                                                                                       \
+        shaper_##ID##_fused_mod(in, out, nch, n, gains, wet, dry, lut, f);                         \
+        break;
+C99DIST_INLINE void shaper_fused_mod(int32_t mode, const float *const *in, float *const *out,
+                                     uint32_t nch, uint32_t n, const float *gains, float wet,
+                                     float dry, const float *lut, c99dist_filters *f)
+{
+    switch (mode)
+    {
+        C99DIST_SHAPERS(SHAPER_CASE_FUSED_MOD)
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+// Sidechain envelope follower.
+// A peak follower on the sidechain input, taken across its channels, moves the drive away from
+// the knob position. The follower is a one pole recursion, so it steps one sample at a time with
+// the channels in the vector lanes. Turning the envelope into per sample drive gains has no
+// recursion and runs over consecutive samples.
+#include "simd.h"
+
+#include <math.h>
+
+#define SIDECHAIN_ATTACK_MS 2.0
+#define SIDECHAIN_RELEASE_MS 120.0
+
+// Once a released envelope drops below this it is stored as zero, from then on a silent or
+// disconnected sidechain skips the follower entirely
+#define SIDECHAIN_FLOOR 1e-4f
+
+typedef struct
+{
+    float env;
+    float attack, release;
+} c99dist_follower;
+
+static inline void follower_reset(c99dist_follower *f) { f->env = 0.f; }
+
+static inline void follower_init(c99dist_follower *f, double sample_rate)
+{
+    f->attack = 1.f - (float)exp(-1000.0 / (SIDECHAIN_ATTACK_MS * sample_rate));
+    f->release = 1.f - (float)exp(-1000.0 / (SIDECHAIN_RELEASE_MS * sample_rate));
+    follower_reset(f);
+}
+
+// Writes the envelope of the loudest of nch channels of in to env. in may be NULL for a silent
+// sidechain, which lets the envelope release.
+static inline void follower_run(c99dist_follower *f, const float *const *in, uint32_t nch,
+                                uint32_t n, float *env)
+{
+    const float attack = f->attack, release = f->release;
+    float e = f->env;
+
+    if (!in)
+    {
+        for (uint32_t i = 0; i < n; i++)
+            env[i] = e -= release * e;
+    }
+    else
+    {
+        float frame[VF_WIDTH] = {0};
+        for (uint32_t i = 0; i < n; i++)
+        {
+            for (uint32_t c = 0; c < nch; c++)
+                frame[c] = in[c][i];
+            vf_store(frame, vf_abs(vf_load(frame)));
+            float peak = frame[0];
+            for (uint32_t c = 1; c < nch; c++)
+                peak = frame[c] > peak ? frame[c] : peak;
+
+            e += (peak > e ? attack : release) * (peak - e);
+            env[i] = e;
+        }
+    }
+
+    f->env = e < SIDECHAIN_FLOOR ? 0.f : e;
+}
+
+// gains[i] = 1 + drive + amount * env[i], with the drive clamped to [dmin, dmax] the same way
+// c99dist_drive_gain clamps the knob
+static inline void sidechain_gains(const float *env, float *gains, uint32_t n, float drive,
+                                   float amount, float dmin, float dmax)
+{
+    const vf_T vdrive = vf_set1(drive), vamount = vf_set1(amount), one = vf_set1(1.f);
+    uint32_t i = 0;
+    for (; i + VF_WIDTH <= n; i += VF_WIDTH)
+    {
+        vf_T d = SIMD_FMA(vf_, vamount, vf_load(env + i), vdrive);
+        vf_store(gains + i, vf_add(one, SIMD_CLAMP(vf_, d, dmin, dmax)));
+    }
+    for (; i < n; i++)
+    {
+        float d = drive + amount * env[i];
+        gains[i] = 1.f + (d < dmin ? dmin : d > dmax ? dmax : d);
+    }
+}
@@ -0,0 +1,254 @@
+#pragma once
+// Tiny 4-lane float abstraction for the DSP kernels.
+// SSE2 on x86/x64, NEON on ARM64 and a plain struct fallback everywhere else, 32-bit ARM
+// included since vdivq_f32 and vcvtnq_s32_f32 only exist on AArch64.
+// Every vf_ op has a matching sf_ op on a single float so that kernels can be written once as a
+// macro template and instantiated for both widths (see shapers.h).
+#include <stdint.h>
+#include <math.h>
+
+#if defined(_MSC_VER)
+#define C99DIST_INLINE static __forceinline
+#else
+#define C99DIST_INLINE static inline __attribute__((always_inline))
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define C99DIST_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define C99DIST_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define VF_WIDTH 4
+
+////////////
+// scalar //
+////////////
+
+typedef float sf_T;
+typedef int sf_M;
+
+C99DIST_INLINE float sf_set1(float a) { return a; }
+C99DIST_INLINE float sf_load(const float *p) { return *p; }
+C99DIST_INLINE void sf_store(float *p, float a) { *p = a; }
+C99DIST_INLINE float sf_add(float a, float b) { return a + b; }
+C99DIST_INLINE float sf_sub(float a, float b) { return a - b; }
+C99DIST_INLINE float sf_mul(float a, float b) { return a * b; }
+C99DIST_INLINE float sf_div(float a, float b) { return a / b; }
+C99DIST_INLINE float sf_min(float a, float b) { return a < b ? a : b; }
+C99DIST_INLINE float sf_max(float a, float b) { return a > b ? a : b; }
+C99DIST_INLINE float sf_abs(float a) { return fabsf(a); }
+C99DIST_INLINE float sf_neg(float a) { return -a; }
+// Round to nearest. Only valid for |a| < 2^31, which is plenty for audio.
+C99DIST_INLINE float sf_round(float a) { return (float)lrintf(a); }
+C99DIST_INLINE sf_M sf_gt(float a, float b) { return a > b; }
+C99DIST_INLINE sf_M sf_lt(float a, float b) { return a < b; }
+C99DIST_INLINE float sf_select(sf_M m, float a, float b) { return m ? a : b; }
+
+////////////
+// vector //
+////////////
+
+#if defined(C99DIST_SIMD_SSE2)
+
+typedef __m128 vf_T;
+typedef __m128 vf_M;
+
+C99DIST_INLINE vf_T vf_set1(float a) { return _mm_set1_ps(a); }
+C99DIST_INLINE vf_T vf_load(const float *p) { return _mm_loadu_ps(p); }
+C99DIST_INLINE void vf_store(float *p, vf_T a) { _mm_storeu_ps(p, a); }
+C99DIST_INLINE vf_T vf_add(vf_T a, vf_T b) { return _mm_add_ps(a, b); }
+C99DIST_INLINE vf_T vf_sub(vf_T a, vf_T b) { return _mm_sub_ps(a, b); }
+C99DIST_INLINE vf_T vf_mul(vf_T a, vf_T b) { return _mm_mul_ps(a, b); }
+C99DIST_INLINE vf_T vf_div(vf_T a, vf_T b) { return _mm_div_ps(a, b); }
+C99DIST_INLINE vf_T vf_min(vf_T a, vf_T b) { return _mm_min_ps(a, b); }
+C99DIST_INLINE vf_T vf_max(vf_T a, vf_T b) { return _mm_max_ps(a, b); }
+C99DIST_INLINE vf_T vf_abs(vf_T a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+C99DIST_INLINE vf_T vf_neg(vf_T a) { return _mm_xor_ps(_mm_set1_ps(-0.f), a); }
+C99DIST_INLINE vf_T vf_round(vf_T a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+C99DIST_INLINE vf_M vf_gt(vf_T a, vf_T b) { return _mm_cmpgt_ps(a, b); }
+C99DIST_INLINE vf_M vf_lt(vf_T a, vf_T b) { return _mm_cmplt_ps(a, b); }
+C99DIST_INLINE vf_T vf_select(vf_M m, vf_T a, vf_T b)
+{
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+#elif defined(C99DIST_SIMD_NEON)
+
+typedef float32x4_t vf_T;
+typedef uint32x4_t vf_M;
+
+C99DIST_INLINE vf_T vf_set1(float a) { return vdupq_n_f32(a); }
+C99DIST_INLINE vf_T vf_load(const float *p) { return vld1q_f32(p); }
+C99DIST_INLINE void vf_store(float *p, vf_T a) { vst1q_f32(p, a); }
+C99DIST_INLINE vf_T vf_add(vf_T a, vf_T b) { return vaddq_f32(a, b); }
+C99DIST_INLINE vf_T vf_sub(vf_T a, vf_T b) { return vsubq_f32(a, b); }
+C99DIST_INLINE vf_T vf_mul(vf_T a, vf_T b) { return vmulq_f32(a, b); }
+C99DIST_INLINE vf_T vf_div(vf_T a, vf_T b) { return vdivq_f32(a, b); }
+C99DIST_INLINE vf_T vf_min(vf_T a, vf_T b) { return vminq_f32(a, b); }
+C99DIST_INLINE vf_T vf_max(vf_T a, vf_T b) { return vmaxq_f32(a, b); }
+C99DIST_INLINE vf_T vf_abs(vf_T a) { return vabsq_f32(a); }
+C99DIST_INLINE vf_T vf_neg(vf_T a) { return vnegq_f32(a); }
+C99DIST_INLINE vf_T vf_round(vf_T a) { return vcvtq_f32_s32(vcvtnq_s32_f32(a)); }
+C99DIST_INLINE vf_M vf_gt(vf_T a, vf_T b) { return vcgtq_f32(a, b); }
+C99DIST_INLINE vf_M vf_lt(vf_T a, vf_T b) { return vcltq_f32(a, b); }
+C99DIST_INLINE vf_T vf_select(vf_M m, vf_T a, vf_T b) { return vbslq_f32(m, a, b); }
+
+#else
+
+typedef struct
+{
+    float v[4];
+} vf_T;
+typedef struct
+{
+    int v[4];
+} vf_M;
+
+// clang-format off
+#define VF_MAP1(expr) vf_T r; for (int k = 0; k < 4; k++) r.v[k] = (expr); return r;
+C99DIST_INLINE vf_T vf_set1(float a) { VF_MAP1(a) }
+C99DIST_INLINE vf_T vf_load(const float *p) { VF_MAP1(p[k]) }
+C99DIST_INLINE void vf_store(float *p, vf_T a) { for (int k = 0; k < 4; k++) p[k] = a.v[k]; }
+C99DIST_INLINE vf_T vf_add(vf_T a, vf_T b) { VF_MAP1(a.v[k] + b.v[k]) }
+C99DIST_INLINE vf_T vf_sub(vf_T a, vf_T b) { VF_MAP1(a.v[k] - b.v[k]) }
+C99DIST_INLINE vf_T vf_mul(vf_T a, vf_T b) { VF_MAP1(a.v[k] * b.v[k]) }
+C99DIST_INLINE vf_T vf_div(vf_T a, vf_T b) { VF_MAP1(a.v[k] / b.v[k]) }
+C99DIST_INLINE vf_T vf_min(vf_T a, vf_T b) { VF_MAP1(sf_min(a.v[k], b.v[k])) }
+C99DIST_INLINE vf_T vf_max(vf_T a, vf_T b) { VF_MAP1(sf_max(a.v[k], b.v[k])) }
+C99DIST_INLINE vf_T vf_abs(vf_T a) { VF_MAP1(fabsf(a.v[k])) }
+C99DIST_INLINE vf_T vf_neg(vf_T a) { VF_MAP1(-a.v[k]) }
+C99DIST_INLINE vf_T vf_round(vf_T a) { VF_MAP1(sf_round(a.v[k])) }
+C99DIST_INLINE vf_M vf_gt(vf_T a, vf_T b) { vf_M m; for (int k = 0; k < 4; k++) m.v[k] = a.v[k] > b.v[k]; return m; }
+C99DIST_INLINE vf_M vf_lt(vf_T a, vf_T b) { vf_M m; for (int k = 0; k < 4; k++) m.v[k] = a.v[k] < b.v[k]; return m; }
+C99DIST_INLINE vf_T vf_select(vf_M m, vf_T a, vf_T b) { VF_MAP1(m.v[k] ? a.v[k] : b.v[k]) }
+#undef VF_MAP1
+// clang-format on
+
+#endif
+
+/////////////////////
+// shared helpers  //
+/////////////////////
+
+C99DIST_INLINE float sf_floor(float a) { return floorf(a); }
+C99DIST_INLINE vf_T vf_floor(vf_T a)
+{
+    vf_T r = vf_round(a);
+    return vf_select(vf_gt(r, a), vf_sub(r, vf_set1(1.f)), r);
+}
+
+// Table lookups at base[idx + off]. idx holds whole numbers that are valid indices.
+C99DIST_INLINE float sf_gather(const float *base, float idx, int off)
+{
+    return base[(int)idx + off];
+}
+C99DIST_INLINE vf_T vf_gather(const float *base, vf_T idx, int off)
+{
+    float fi[VF_WIDTH], v[VF_WIDTH];
+    vf_store(fi, idx);
+    for (int k = 0; k < VF_WIDTH; k++)
+        v[k] = base[(int)fi[k] + off];
+    return vf_load(v);
+}
+
+// These are written once against the P##op naming scheme and expanded for both widths.
+// clang-format off
+#define SIMD_CLAMP(P, x, lo, hi) P##min(P##max((x), P##set1(lo)), P##set1(hi))
+#define SIMD_FMA(P, a, b, c)     P##add(P##mul((a), (b)), (c))
+// clang-format on
+
+// sin(2*pi*x) for any x. Reduces to [-1/4, 1/4] turns and evaluates an odd Taylor polynomial
+// to t^11, which is accurate to ~1e-7 over the reduced range.
+#define SIMD_SIN2PI_BODY(P, x)                                                                     \
+    P##T r = P##sub((x), P##round(x)); /* [-0.5, 0.5] */                                           \
+    r = P##select(P##gt(r, P##set1(0.25f)), P##sub(P##set1(0.5f), r), r);                          \
+    r = P##select(P##lt(r, P##set1(-0.25f)), P##sub(P##set1(-0.5f), r), r);                        \
+    P##T t = P##mul(r, P##set1(6.28318530717958647692f));                                          \
+    P##T t2 = P##mul(t, t);                                                                        \
+    P##T p = P##set1(-2.50521083854417e-08f);                                                      \
+    p = SIMD_FMA(P, p, t2, P##set1(2.75573192239859e-06f));                                        \
+    p = SIMD_FMA(P, p, t2, P##set1(-1.98412698412698e-04f));                                       \
+    p = SIMD_FMA(P, p, t2, P##set1(8.33333333333333e-03f));                                        \
+    p = SIMD_FMA(P, p, t2, P##set1(-1.66666666666667e-01f));                                       \
+    p = SIMD_FMA(P, p, t2, P##set1(1.f));                                                          \
+    return P##mul(p, t);
+
+// atan(x) for any x. Reflects |x| > 1 through atan(x) = sign(x) * pi/2 - atan(1/x) and uses a
+// minimax polynomial on [-1, 1] (max error ~1e-5 rad).
+#define SIMD_ATAN_BODY(P, x)                                                                       \
+    P##T ax = P##abs(x);                                                                           \
+    P##M big = P##gt(ax, P##set1(1.f));                                                            \
+    P##T z = P##select(big, P##div(P##set1(1.f), P##max(ax, P##set1(1.f))), ax);                   \
+    P##T z2 = P##mul(z, z);                                                                        \
+    P##T p = P##set1(-0.01172120f);                                                                \
+    p = SIMD_FMA(P, p, z2, P##set1(0.05265332f));                                                  \
+    p = SIMD_FMA(P, p, z2, P##set1(-0.11643287f));                                                 \
+    p = SIMD_FMA(P, p, z2, P##set1(0.19354346f));                                                  \
+    p = SIMD_FMA(P, p, z2, P##set1(-0.33262347f));                                                 \
+    p = SIMD_FMA(P, p, z2, P##set1(0.99997726f));                                                  \
+    p = P##mul(p, z);                                                                              \
+    p = P##select(big, P##sub(P##set1(1.57079632679489662f), p), p);                               \
+    return P##select(P##lt(x, P##set1(0.f)), P##neg(p), p);
+
+C99DIST_INLINE float sf_sin2pi(float x) { SIMD_SIN2PI_BODY(sf_, x) }
+C99DIST_INLINE vf_T vf_sin2pi(vf_T x) { SIMD_SIN2PI_BODY(vf_, x) }
+C99DIST_INLINE float sf_atan(float x) { SIMD_ATAN_BODY(sf_, x) }
+C99DIST_INLINE vf_T vf_atan(vf_T x) { SIMD_ATAN_BODY(vf_, x) }
+
+////////////////////////////////
+// floating point environment //
+////////////////////////////////
+
+// simd_flush_denormals makes the calling thread treat denormals as zero, both as inputs and as
+// results, and returns the previous mode for simd_restore_fp_mode. That is FTZ and DAZ in MXCSR
+// on x86, FZ in FPCR on ARM64 and FZ in FPSCR on 32-bit ARM with a VFP unit. The mode belongs to
+// the CPU rather than the vector backend, so the struct fallback on 32-bit ARM flushes too.
+// Anything else leaves the mode alone.
+typedef uint64_t simd_fp_mode;
+
+#if defined(C99DIST_SIMD_SSE2)
+#define SIMD_MXCSR_FTZ_DAZ 0x8040
+C99DIST_INLINE simd_fp_mode simd_flush_denormals(void)
+{
+    unsigned int old = _mm_getcsr();
+    _mm_setcsr(old | SIMD_MXCSR_FTZ_DAZ);
+    return old;
+}
+C99DIST_INLINE void simd_restore_fp_mode(simd_fp_mode mode) { _mm_setcsr((unsigned int)mode); }
+#elif defined(_M_ARM64) || defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FP))
+#define SIMD_FPCR_FZ (1u << 24) // same bit in FPCR and FPSCR
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SIMD_GET_FPCR() ((simd_fp_mode)_ReadStatusReg(ARM64_FPCR))
+#define SIMD_SET_FPCR(v) _WriteStatusReg(ARM64_FPCR, (__int64)(v))
+#elif defined(__aarch64__)
+#define SIMD_GET_FPCR()                                                                            \
+    __extension__({                                                                                \
+        uint64_t r;                                                                                \
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(r));                                            \
+        r;                                                                                         \
+    })
+#define SIMD_SET_FPCR(v) __asm__ __volatile__("msr fpcr, %0" : : "r"((uint64_t)(v)))
+#else
+#define SIMD_GET_FPCR()                                                                            \
+    __extension__({                                                                                \
+        uint32_t r;                                                                                \
+        __asm__ __volatile__("vmrs %0, fpscr" : "=r"(r));                                          \
+        (simd_fp_mode)r;                                                                           \
+    })
+#define SIMD_SET_FPCR(v) __asm__ __volatile__("vmsr fpscr, %0" : : "r"((uint32_t)(v)))
+#endif
+C99DIST_INLINE simd_fp_mode simd_flush_denormals(void)
+{
+    simd_fp_mode old = SIMD_GET_FPCR();
+    SIMD_SET_FPCR(old | SIMD_FPCR_FZ);
+    return old;
+}
+C99DIST_INLINE void simd_restore_fp_mode(simd_fp_mode mode) { SIMD_SET_FPCR(mode); }
+#else
+C99DIST_INLINE simd_fp_mode simd_flush_denormals(void) { return 0; }
+C99DIST_INLINE void simd_restore_fp_mode(simd_fp_mode mode) { (void)mode; }
+#endif
@@ -0,0 +1,122 @@
+// Real time allocation test.
+// process() must never touch the heap, and neither may the thread pool tasks it hands out. Every
+// plugin runs its shapers, multiband with a thread pool, lookahead and the sidechain with
+// parameters changing inside each block and state loaded between blocks, while the host counts
+// the heap calls the plugin makes. Any call fails the test. Without a way to count them (see
+// test_alloc_counting) it is skipped.
+//
+// usage: c99dist_alloc <plugin>
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ALLOC_SKIPPED 77 // SKIP_RETURN_CODE in tests/CMakeLists.txt
+#define ALLOC_WORKERS 2
+#define ALLOC_BANDS 4
+
+static const uint32_t s_blocks[] = {1, 64, 512, 1024};
+
+static float s_input[2][TEST_MAX_FRAMES];
+static float s_output[2][TEST_MAX_FRAMES];
+static float s_sidechain[2][TEST_MAX_FRAMES];
+
+// Blocks of every size with a parameter change in the middle of each, true if none allocated
+static bool alloc_run(const clap_plugin_t *plugin, uint32_t nch, int32_t modes)
+{
+    const uint64_t before = test_process_allocs();
+    const float *in[2] = {s_input[0], s_input[1]};
+    float *out[2] = {s_output[0], s_output[1]};
+    const float *sc[2] = {s_sidechain[0], s_sidechain[1]};
+    for (size_t k = 0; k < sizeof(s_blocks) / sizeof(s_blocks[0]); k++)
+        for (int32_t m = 0; m < modes; m++)
+        {
+            test_param(s_blocks[k] / 2, TEST_PID_MODE, m);
+            test_param(s_blocks[k] / 2, TEST_PID_BAND_MODE + m % ALLOC_BANDS, m);
+            test_param(s_blocks[k] / 2, TEST_PID_DRIVE, 0.5 + m);
+            test_param(s_blocks[k] / 2, TEST_PID_LOW_CUT, 100. * (m + 1));
+            test_param(s_blocks[k] - 1, TEST_PID_CROSSOVER, 200. + 50. * m);
+            test_process(plugin, in, out, nch, s_blocks[k], m % 2 ? sc : NULL);
+        }
+    return test_process_allocs() == before;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <plugin>\n", argv[0]);
+        return 2;
+    }
+    if (!test_alloc_counting())
+    {
+        printf("the host can't count heap calls in this build, skipped\n");
+        return ALLOC_SKIPPED;
+    }
+    if (!test_plugin_load(argv[1]) || !test_thread_pool_start(ALLOC_WORKERS))
+        return 1;
+    test_signal(s_input[0], s_input[1], TEST_MAX_FRAMES);
+    test_signal(s_sidechain[1], s_sidechain[0], TEST_MAX_FRAMES);
+
+    const uint32_t count = test_plugin_count();
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const char *name = test_plugin_descriptor(i)->name;
+
+        // Creating the plugin allocates, which shows the host sees the plugin's heap calls
+        const uint64_t before = test_allocs();
+        const clap_plugin_t *plugin = test_plugin_create(i);
+        if (!plugin)
+        {
+            fprintf(stderr, "%s: can't create the plugin\n", name);
+            return 1;
+        }
+        if (test_allocs() == before)
+        {
+            fprintf(stderr, "%s: the host doesn't see the plugin's heap calls\n", name);
+            return 1;
+        }
+        const uint32_t nch = test_plugin_channels(plugin);
+        clap_param_info_t info;
+        const int32_t modes = test_param_info(plugin, TEST_PID_MODE, &info)
+                                  ? (int32_t)info.max_value + 1
+                                  : 1;
+
+        // Single band, then multiband across the pool, then the same after a state load
+        bool ok = alloc_run(plugin, nch, modes);
+        test_param(0, TEST_PID_BANDS, ALLOC_BANDS);
+        test_param(0, TEST_PID_SIDECHAIN, 3.);
+        ok = alloc_run(plugin, nch, modes) && ok;
+        test_stream state = {0};
+        if (!test_state_save(plugin, &state) || !test_state_load(plugin, &state))
+        {
+            fprintf(stderr, "%s: state didn't save and load\n", name);
+            return 1;
+        }
+        test_stream_free(&state);
+        ok = alloc_run(plugin, nch, modes) && ok;
+
+        // Lookahead only starts with the next activation
+        test_param(0, TEST_PID_LOOKAHEAD, 1.);
+        test_flush(plugin);
+        if (!test_plugin_restart(plugin))
+        {
+            fprintf(stderr, "%s: restart failed\n", name);
+            return 1;
+        }
+        ok = alloc_run(plugin, nch, modes) && ok;
+        if (!ok)
+        {
+            fprintf(stderr, "%s: allocated while processing\n", name);
+            failures++;
+        }
+        test_plugin_destroy(plugin);
+    }
+
+    test_thread_pool_stop();
+    test_plugin_unload();
+    printf("%u of %u plugins processed without touching the heap\n",
+           (unsigned)(count - failures), (unsigned)count);
+    return failures ? 1 : 0;
+}
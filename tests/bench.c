@@ -0,0 +1,489 @@
+// Performance regression test.
+// Times the plugin over a second of the test signal for every shaper in the registry and for the
+// filter, multiband, lookahead and sidechain paths, and reports nanoseconds per sample (per frame
+// and channel). Tail cases feed a signal decaying through the denormal range into silence, and
+// fail outright when they run much slower than the same settings on the steady signal, which is
+// what a denormal stall looks like. A thousand instances taking turns on 32 frame blocks show
+// the per call overhead when every call finds its instance out of cache, to set against the
+// single instance block-32 case. Parameter text formatting and parsing are timed per call,
+// next to snprintf and strtod doing the same job. Each case keeps the best of many passes spread
+// over several rounds, which filters out most of the noise from the rest of the machine. A fixed
+// reference loop is timed next to every case and the comparison against the baseline is made in
+// multiples of it, so a machine running at a different clock doesn't read as a regression. The
+// test fails when a case has slowed down relative to the reference by more than the given
+// percentage.
+//
+// usage: c99dist_bench <plugin> <baseline> <tolerance %> [--record]
+//
+// Baselines only mean something on the machine and build that recorded them, so the build keeps
+// its own. When the file doesn't exist, or with --record, the results are written to it instead.
+// The file has one "name ns" pair per line, the reference loop among them, and # starts a
+// comment.
+#include "host.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_FRAMES 48000
+// Shared machines have busy spells of a few hundred milliseconds that slow vector code down by
+// half, so rather than one long run each case gets short runs in many rounds spread over the
+// whole benchmark and keeps the fastest
+#define BENCH_PASSES 5      // at least this many passes per case and round
+#define BENCH_MIN_TIME 0.01 // and at least this many seconds of them
+#define BENCH_ROUNDS 7
+#define BENCH_CONFIRM_TIME 5.0
+#define BENCH_TAIL_LIMIT 1.5 // most a tail case may take over its steady case
+#define BENCH_MAX_CASES 64
+#define BENCH_TEXT_POINTS 16 // values per parameter for the text cases
+#define BENCH_MAX_TEXTS 1024
+#define BENCH_INSTANCES 1000
+#define BENCH_INSTANCE_BLOCKS 16 // blocks each instance processes per pass
+
+typedef struct bench_case bench_case;
+struct bench_case
+{
+    char name[64];
+    double (*run)(const bench_case *c); // ns per sample
+    int32_t mode;
+    void (*setup)(void); // queues events for anything beyond the mode
+    bool restart;        // setup changes something that only applies at activation
+    bool sidechain;
+    uint32_t block;
+    const char *steady; // set for a tail case, the case it is measured against
+};
+
+static float s_input[2][BENCH_FRAMES];
+static float s_output[2][BENCH_FRAMES];
+static float s_tail[2][BENCH_FRAMES];
+static volatile float s_sink;
+
+static void setup_filters(void)
+{
+    test_param(0, TEST_PID_LOW_CUT, 200.);
+    test_param(0, TEST_PID_EMPHASIS, 6.);
+    test_param(0, TEST_PID_HIGH_CUT, 8000.);
+}
+
+static void setup_no_dc(void) { test_param(0, TEST_PID_DC_BLOCK, 0.); }
+
+static void setup_bands(void) { test_param(0, TEST_PID_BANDS, 3.); }
+
+static void setup_lookahead(void) { test_param(0, TEST_PID_LOOKAHEAD, 1.); }
+
+static void setup_sidechain(void) { test_param(0, TEST_PID_SIDECHAIN, 3.); }
+
+// Creates the full plugin set up for c, NULL on failure
+static const clap_plugin_t *bench_plugin(const bench_case *c)
+{
+    const clap_plugin_t *plugin = test_plugin_create(0);
+    if (!plugin)
+        return NULL;
+    test_param(0, TEST_PID_MODE, c->mode);
+    test_param(0, TEST_PID_DRIVE, 2.);
+    test_param(0, TEST_PID_MIX, 0.8);
+    if (c->setup)
+        c->setup();
+    test_flush(plugin);
+    if (c->restart && !test_plugin_restart(plugin))
+    {
+        test_plugin_destroy(plugin);
+        return NULL;
+    }
+    return plugin;
+}
+
+// The test signal fading by 900 dB over the first half, which takes it through the denormal range
+// down to zero, then silence for the filters and crossovers to ring out in
+static void bench_tail_init(void)
+{
+    for (uint32_t c = 0; c < 2; c++)
+        for (uint32_t i = 0; i < BENCH_FRAMES; i++)
+        {
+            const double fade = i < BENCH_FRAMES / 2 ? pow(10., -45. * i / (BENCH_FRAMES / 2)) : 0.;
+            s_tail[c][i] = (float)(s_input[c][i] * fade);
+        }
+}
+
+// Seconds for one pass over the input in blocks of block frames
+static double bench_pass(const clap_plugin_t *plugin, const bench_case *c)
+{
+    const float(*input)[BENCH_FRAMES] = c->steady ? s_tail : s_input;
+    const uint32_t block = c->block;
+    const double start = test_seconds();
+    for (uint32_t at = 0; at + block <= BENCH_FRAMES; at += block)
+    {
+        const float *in[2] = {input[0] + at, input[1] + at};
+        float *out[2] = {s_output[0] + at, s_output[1] + at};
+        test_process(plugin, in, out, 2, block, c->sidechain ? in : NULL);
+    }
+    return test_seconds() - start;
+}
+
+static double bench_audio(const bench_case *c)
+{
+    const clap_plugin_t *plugin = bench_plugin(c);
+    if (!plugin)
+        return -1.;
+    double best = bench_pass(plugin, c); // warms the caches up
+    double total = 0.;
+    for (int p = 0; p < BENCH_PASSES || total < BENCH_MIN_TIME; p++)
+    {
+        const double t = bench_pass(plugin, c);
+        best = t < best ? t : best;
+        total += t;
+    }
+    test_plugin_destroy(plugin);
+    return 1e9 * best / ((double)(BENCH_FRAMES / c->block * c->block) * 2);
+}
+
+static const clap_plugin_t *s_instances[BENCH_INSTANCES];
+
+// Every instance processes a block before any processes the next, the way a host with a large
+// session works through its graph, so each call starts with the instance's state evicted by the
+// ones before it. The instances are kept for every round and destroyed at the end.
+static double bench_instances(const bench_case *c)
+{
+    for (int k = 0; k < BENCH_INSTANCES; k++)
+        if (!s_instances[k] && !(s_instances[k] = bench_plugin(c)))
+            return -1.;
+    const uint32_t block = c->block;
+    double best = -1., total = 0.;
+    for (int p = 0; p < BENCH_PASSES || total < BENCH_MIN_TIME; p++)
+    {
+        const double start = test_seconds();
+        for (uint32_t at = 0; at < BENCH_INSTANCE_BLOCKS * block; at += block)
+        {
+            const float *in[2] = {s_input[0] + at, s_input[1] + at};
+            float *out[2] = {s_output[0] + at, s_output[1] + at};
+            for (int k = 0; k < BENCH_INSTANCES; k++)
+                test_process(s_instances[k], in, out, 2, block, NULL);
+        }
+        const double t = test_seconds() - start;
+        best = best < 0. || t < best ? t : best;
+        total += t;
+    }
+    return 1e9 * best / ((double)BENCH_INSTANCES * BENCH_INSTANCE_BLOCKS * block * 2);
+}
+
+static void bench_instances_free(void)
+{
+    for (int k = 0; k < BENCH_INSTANCES; k++)
+        if (s_instances[k])
+            test_plugin_destroy(s_instances[k]);
+}
+
+// Every parameter at BENCH_TEXT_POINTS values across its range, with the plugin's text for each
+typedef struct
+{
+    clap_id id;
+    double value;
+    char text[CLAP_NAME_SIZE];
+} bench_text;
+
+static bench_text s_texts[BENCH_MAX_TEXTS];
+static uint32_t s_text_count;
+
+static void bench_texts_init(const clap_plugin_t *plugin)
+{
+    const clap_plugin_params_t *params = test_params(plugin);
+    for (uint32_t i = 0; i < params->count(plugin); i++)
+    {
+        clap_param_info_t info;
+        params->get_info(plugin, i, &info);
+        for (int p = 0; p < BENCH_TEXT_POINTS && s_text_count < BENCH_MAX_TEXTS; p++)
+        {
+            bench_text *t = &s_texts[s_text_count];
+            t->id = info.id;
+            t->value = info.min_value + (info.max_value - info.min_value) * p /
+                                            (BENCH_TEXT_POINTS - 1);
+            if (params->value_to_text(plugin, t->id, t->value, t->text, sizeof(t->text)))
+                s_text_count++;
+        }
+    }
+}
+
+typedef double (*bench_text_op)(const clap_plugin_t *plugin, const bench_text *t);
+
+static double op_value_to_text(const clap_plugin_t *plugin, const bench_text *t)
+{
+    char text[CLAP_NAME_SIZE];
+    test_params(plugin)->value_to_text(plugin, t->id, t->value, text, sizeof(text));
+    return text[0];
+}
+
+static double op_snprintf(const clap_plugin_t *plugin, const bench_text *t)
+{
+    char text[CLAP_NAME_SIZE];
+    snprintf(text, sizeof(text), "%.2f dB", t->value);
+    return text[0];
+}
+
+static double op_text_to_value(const clap_plugin_t *plugin, const bench_text *t)
+{
+    double v = 0.;
+    test_params(plugin)->text_to_value(plugin, t->id, t->text, &v);
+    return v;
+}
+
+static double op_strtod(const clap_plugin_t *plugin, const bench_text *t)
+{
+    return strtod(t->text, NULL);
+}
+
+// ns per call of op over every text
+static double bench_text_run(bench_text_op op)
+{
+    const clap_plugin_t *plugin = s_text_count ? test_plugin_create(0) : NULL;
+    if (!plugin)
+        return -1.;
+    double best = -1., total = 0., sum = 0.;
+    for (int p = 0; p < BENCH_PASSES || total < BENCH_MIN_TIME; p++)
+    {
+        const double start = test_seconds();
+        for (uint32_t k = 0; k < s_text_count; k++)
+            sum += op(plugin, &s_texts[k]);
+        const double t = test_seconds() - start;
+        best = best < 0. || t < best ? t : best;
+        total += t;
+    }
+    s_sink = (float)sum;
+    test_plugin_destroy(plugin);
+    return 1e9 * best / s_text_count;
+}
+
+static double bench_value_to_text(const bench_case *c) { return bench_text_run(op_value_to_text); }
+static double bench_snprintf(const bench_case *c) { return bench_text_run(op_snprintf); }
+static double bench_text_to_value(const bench_case *c) { return bench_text_run(op_text_to_value); }
+static double bench_strtod(const bench_case *c) { return bench_text_run(op_strtod); }
+
+// ns per sample of a scalar rational tanh over the input. The running sum is a dependency chain
+// the compiler can't vectorise, so this times the core rather than any particular codegen.
+static double bench_reference(void)
+{
+    double best = 0.;
+    for (int p = 0; p < BENCH_PASSES; p++)
+    {
+        const double start = test_seconds();
+        float sum = 0.f;
+        for (uint32_t c = 0; c < 2; c++)
+            for (uint32_t i = 0; i < BENCH_FRAMES; i++)
+            {
+                const float x = s_input[c][i];
+                sum += x * (27.f + x * x) / (27.f + 9.f * x * x);
+            }
+        s_sink = sum;
+        const double t = test_seconds() - start;
+        best = p == 0 || t < best ? t : best;
+    }
+    return 1e9 * best / (BENCH_FRAMES * 2.);
+}
+
+// One more round of c. ns and the reference, which is timed along with every case, keep the
+// best seen, negative means none yet.
+static void bench_measure(const bench_case *c, double *ns, double *reference)
+{
+    const double ref = bench_reference();
+    const double t = c->run(c);
+    *reference = *reference < 0. || ref < *reference ? ref : *reference;
+    if (t >= 0.)
+        *ns = *ns < 0. || t < *ns ? t : *ns;
+}
+
+// Percent change from the baseline, in multiples of the reference
+static double bench_change(double ns, double reference, double base, double base_reference)
+{
+    return 100. * ((ns / reference) / (base / base_reference) - 1.);
+}
+
+// True when a case with a baseline is over it by more than tolerance percent
+static bool bench_slow(double ns, double reference, double base, double base_reference,
+                       double tolerance)
+{
+    return base > 0. && bench_change(ns, reference, base, base_reference) > tolerance;
+}
+
+// Index of the case called name, or -1
+static int bench_find(const bench_case *cases, int count, const char *name)
+{
+    for (int k = 0; k < count; k++)
+        if (!strcmp(cases[k].name, name))
+            return k;
+    return -1;
+}
+
+// How many times its steady case a tail case takes, 0 for other cases
+static double bench_tail_ratio(const bench_case *cases, int count, const double *ns, int k)
+{
+    const int steady = cases[k].steady ? bench_find(cases, count, cases[k].steady) : -1;
+    return steady >= 0 && ns[k] > 0. && ns[steady] > 0. ? ns[k] / ns[steady] : 0.;
+}
+
+// The baseline value for name, or a negative one if there is none
+static double bench_baseline(const char *path, const char *name)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1.;
+    char line[256], key[128];
+    double value, found = -1.;
+    while (found < 0. && fgets(line, sizeof(line), f))
+        if (line[0] != '#' && sscanf(line, "%127s %lf", key, &value) == 2 && !strcmp(key, name))
+            found = value;
+    fclose(f);
+    return found;
+}
+
+static bool bench_record(const char *path, const bench_case *cases, const double *ns, int count,
+                         double reference)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        fprintf(stderr, "can't write %s\n", path);
+        return false;
+    }
+    fprintf(f, "# ns per sample, best of %d rounds over %d frames\n", BENCH_ROUNDS, BENCH_FRAMES);
+    fprintf(f, "reference %.4f\n", reference);
+    for (int k = 0; k < count; k++)
+        fprintf(f, "%s %.4f\n", cases[k].name, ns[k]);
+    fclose(f);
+    printf("recorded %s\n", path);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "usage: %s <plugin> <baseline> <tolerance %%> [--record]\n", argv[0]);
+        return 2;
+    }
+    const char *baseline = argv[2];
+    const double tolerance = atof(argv[3]);
+    bool record = argc > 4 && !strcmp(argv[4], "--record");
+
+    if (!test_plugin_load(argv[1]))
+        return 1;
+    test_signal(s_input[0], s_input[1], BENCH_FRAMES);
+    bench_tail_init();
+
+    static bench_case cases[BENCH_MAX_CASES];
+    int count = 0;
+
+    // Every registry mode with the default settings, then the other signal paths
+    const clap_plugin_t *plugin = test_plugin_create(0);
+    if (!plugin)
+    {
+        fprintf(stderr, "can't create the plugin\n");
+        return 1;
+    }
+    clap_param_info_t mode_info;
+    const int32_t modes =
+        test_param_info(plugin, TEST_PID_MODE, &mode_info) ? (int32_t)mode_info.max_value + 1 : 0;
+    for (int32_t m = 0; m < modes && count < BENCH_MAX_CASES / 2; m++)
+    {
+        char text[CLAP_NAME_SIZE];
+        bench_case *c = &cases[count++];
+        c->run = bench_audio;
+        c->mode = m;
+        c->block = 512;
+        if (!test_params(plugin)->value_to_text(plugin, TEST_PID_MODE, m, text, sizeof(text)))
+            snprintf(text, sizeof(text), "mode %d", (int)m);
+        test_slug(c->name, sizeof(c->name), text);
+    }
+    bench_texts_init(plugin);
+    test_plugin_destroy(plugin);
+
+    const bench_case extra[] = {
+        {.name = "no-dc-block", .run = bench_audio, .mode = 1, .setup = setup_no_dc, .block = 512},
+        {.name = "filters", .run = bench_audio, .mode = 1, .setup = setup_filters, .block = 512},
+        {.name = "bands", .run = bench_audio, .mode = 1, .setup = setup_bands, .block = 512},
+        {.name = "lookahead", .run = bench_audio, .mode = 1, .setup = setup_lookahead,
+         .restart = true, .block = 512},
+        {.name = "sidechain", .run = bench_audio, .mode = 1, .setup = setup_sidechain,
+         .sidechain = true, .block = 512},
+        {.name = "block-32", .run = bench_audio, .mode = 1, .block = 32},
+        {.name = "instances-1000", .run = bench_instances, .mode = 1, .block = 32},
+        {.name = "tail-filters", .run = bench_audio, .mode = 1, .setup = setup_filters,
+         .block = 512, .steady = "filters"},
+        {.name = "tail-bands", .run = bench_audio, .mode = 1, .setup = setup_bands, .block = 512,
+         .steady = "bands"},
+        {.name = "value-to-text", .run = bench_value_to_text},
+        {.name = "snprintf", .run = bench_snprintf},
+        {.name = "text-to-value", .run = bench_text_to_value},
+        {.name = "strtod", .run = bench_strtod},
+    };
+    for (size_t k = 0; k < sizeof(extra) / sizeof(extra[0]); k++)
+        cases[count++] = extra[k];
+
+    FILE *probe = fopen(baseline, "r");
+    if (probe)
+        fclose(probe);
+    else
+        record = true;
+
+    const double base_reference = record ? -1. : bench_baseline(baseline, "reference");
+    static double ns[BENCH_MAX_CASES], base[BENCH_MAX_CASES];
+    double reference = -1.;
+    for (int k = 0; k < count; k++)
+    {
+        ns[k] = -1.;
+        base[k] = base_reference > 0. ? bench_baseline(baseline, cases[k].name) : -1.;
+    }
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (int k = 0; k < count; k++)
+            bench_measure(&cases[k], &ns[k], &reference);
+
+    // A case that looks slower is measured again until it doesn't or BENCH_CONFIRM_TIME has
+    // passed. A real regression stays, a busy spell on the machine doesn't.
+    for (int k = 0; k < count; k++)
+    {
+        const double start = test_seconds();
+        while (ns[k] >= 0. &&
+               (bench_slow(ns[k], reference, base[k], base_reference, tolerance) ||
+                bench_tail_ratio(cases, count, ns, k) > BENCH_TAIL_LIMIT) &&
+               test_seconds() - start < BENCH_CONFIRM_TIME)
+            bench_measure(&cases[k], &ns[k], &reference);
+    }
+
+    int failures = 0;
+    printf("%-24s %10s %10s %8s\n", "case", "ns/sample", "baseline", "change");
+    printf("%-24s %10.3f %10.3f\n", "reference", reference, base_reference);
+    for (int k = 0; k < count; k++)
+    {
+        if (ns[k] < 0.)
+        {
+            fprintf(stderr, "%s: failed to run\n", cases[k].name);
+            failures++;
+            continue;
+        }
+        const double tail = bench_tail_ratio(cases, count, ns, k);
+        if (tail > BENCH_TAIL_LIMIT)
+        {
+            fprintf(stderr, "%s: %.1f times as slow as %s, denormals are getting through\n",
+                    cases[k].name, tail, cases[k].steady);
+            failures++;
+        }
+        if (base[k] <= 0.)
+        {
+            printf("%-24s %10.3f %10s\n", cases[k].name, ns[k], "-");
+            continue;
+        }
+        const double change = bench_change(ns[k], reference, base[k], base_reference);
+        const bool slow = bench_slow(ns[k], reference, base[k], base_reference, tolerance);
+        printf("%-24s %10.3f %10.3f %+7.1f%%%s\n", cases[k].name, ns[k], base[k], change,
+               slow ? "  SLOWER" : "");
+        failures += slow;
+    }
+    bench_instances_free();
+    test_plugin_unload();
+
+    if (record)
+        return failures || !bench_record(baseline, cases, ns, count, reference) ? 1 : 0;
+    if (failures)
+        fprintf(stderr, "%d cases failed, the limit is %g%% over %s\n", failures, tolerance,
+                baseline);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+// Event timing test.
+// Hosts are allowed to be sloppy with event times, and none of it may lose an event. One stamped
+// at or past the end of the block has to be applied by the end of that block, and an empty block
+// still carries its events, even with a sidechain whose buffers can't be read.
+//
+// usage: c99dist_events <plugin>
+#include "host.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define EVENTS_BLOCK 64
+
+static int s_failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do                                                                                             \
+    {                                                                                              \
+        if (!(cond))                                                                               \
+        {                                                                                          \
+            fprintf(stderr, __VA_ARGS__);                                                          \
+            fputc('\n', stderr);                                                                   \
+            s_failures++;                                                                          \
+        }                                                                                          \
+    } while (0)
+
+static double events_value(const clap_plugin_t *plugin, clap_id id)
+{
+    double v = NAN;
+    test_params(plugin)->get_value(plugin, id, &v);
+    return v;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <plugin>\n", argv[0]);
+        return 2;
+    }
+    if (!test_plugin_load(argv[1]))
+        return 1;
+    const clap_plugin_t *plugin = test_plugin_create(0);
+    if (!plugin)
+    {
+        fprintf(stderr, "can't create the plugin\n");
+        return 1;
+    }
+
+    static float input[2][EVENTS_BLOCK], output[2][EVENTS_BLOCK];
+    test_signal(input[0], input[1], EVENTS_BLOCK);
+    const float *in[2] = {input[0], input[1]};
+    float *out[2] = {output[0], output[1]};
+
+    // One on the frame after the last, one far past it and one in the block after those
+    test_param(EVENTS_BLOCK / 2, TEST_PID_OUTPUT, -6.);
+    test_param(EVENTS_BLOCK, TEST_PID_MIX, 0.25);
+    test_param(10 * EVENTS_BLOCK, TEST_PID_DRIVE, 1.5);
+    test_process(plugin, in, out, 2, EVENTS_BLOCK, NULL);
+    CHECK(events_value(plugin, TEST_PID_OUTPUT) == -6., "an event inside the block was lost");
+    CHECK(events_value(plugin, TEST_PID_MIX) == 0.25, "an event at the block end was lost");
+    CHECK(events_value(plugin, TEST_PID_DRIVE) == 1.5, "an event past the block end was lost");
+
+    // The sidechain has channels but nothing behind them, which an empty block never reads
+    static const float *const no_sidechain[2] = {NULL, NULL};
+    test_param(0, TEST_PID_SIDECHAIN, 2.);
+    test_param(0, TEST_PID_MODE, 3.);
+    test_process(plugin, in, out, 2, 0, no_sidechain);
+    CHECK(events_value(plugin, TEST_PID_SIDECHAIN) == 2., "an event in an empty block was lost");
+    CHECK(events_value(plugin, TEST_PID_MODE) == 3., "an event in an empty block was lost");
+
+    test_plugin_destroy(plugin);
+    test_plugin_unload();
+    if (s_failures)
+        fprintf(stderr, "%d event checks failed\n", s_failures);
+    return s_failures ? 1 : 0;
+}
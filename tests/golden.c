@@ -0,0 +1,270 @@
+// Golden output test.
+// Renders the test signal through every shaper in the registry, and through the filter, multiband,
+// lookahead and sidechain paths, and compares each against a render stored in tests/golden. Any
+// change that moves a sample further than the tolerance fails, so kernel or compiler changes that
+// alter the sound can't slip in unnoticed. Every fixed variant has to match the full plugin in its
+// mode as well.
+//
+// usage: c99dist_golden <plugin> <golden dir> <tolerance> [--update]
+//
+// --update rewrites the stored renders. Only do that for an intended change in the sound. The
+// files are planar little endian float32, one channel after the other.
+#include "host.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GOLDEN_FRAMES 1024
+#define GOLDEN_BLOCK 128
+#define GOLDEN_DRIVE_MAX 4.0
+
+typedef struct
+{
+    char name[64];
+    int32_t mode;
+    void (*setup)(void); // queues events for anything beyond the mode
+    bool restart;        // setup changes something that only applies at activation
+    bool sidechain;
+} golden_case;
+
+static void setup_filters(void)
+{
+    test_param(0, TEST_PID_LOW_CUT, 200.);
+    test_param(0, TEST_PID_EMPHASIS, 6.);
+    test_param(0, TEST_PID_HIGH_CUT, 8000.);
+    test_param(0, TEST_PID_OUTPUT, -3.);
+}
+
+static void setup_bands(void)
+{
+    test_param(0, TEST_PID_BANDS, 3.);
+    test_param(0, TEST_PID_BAND_MODE + 0, 1.);
+    test_param(0, TEST_PID_BAND_MODE + 1, 3.);
+    test_param(0, TEST_PID_BAND_MODE + 2, 2.);
+    test_param(0, TEST_PID_BAND_DRIVE + 2, 1.5);
+    test_param(0, TEST_PID_BAND_MIX + 1, 0.6);
+}
+
+static void setup_lookahead(void)
+{
+    test_param(0, TEST_PID_LOOKAHEAD, 1.);
+    test_param(0, TEST_PID_AUTO_GAIN, 1.);
+}
+
+static void setup_sidechain(void) { test_param(0, TEST_PID_SIDECHAIN, 3.); }
+
+static float s_input[2][GOLDEN_FRAMES];
+
+// Renders c through plugin index into out, false if the plugin fails
+static bool golden_render(uint32_t index, const golden_case *c, float out[2][GOLDEN_FRAMES])
+{
+    const clap_plugin_t *plugin = test_plugin_create(index);
+    if (!plugin)
+        return false;
+    const uint32_t nch = test_plugin_channels(plugin);
+
+    test_param(0, TEST_PID_MODE, c->mode);
+    test_param(0, TEST_PID_MIX, 1.);
+    if (c->setup)
+        c->setup();
+    test_flush(plugin);
+    bool ok = !c->restart || test_plugin_restart(plugin);
+
+    // Drive rises block by block, with a second event inside each block so the sub-block split
+    // at event times is covered too
+    const uint32_t blocks = GOLDEN_FRAMES / GOLDEN_BLOCK;
+    for (uint32_t b = 0; ok && b < blocks; b++)
+    {
+        const double drive = GOLDEN_DRIVE_MAX * b / (blocks - 1);
+        test_param(0, TEST_PID_DRIVE, drive);
+        test_param(GOLDEN_BLOCK / 3, TEST_PID_DRIVE, drive + 0.25);
+        if (b == blocks / 2)
+            test_param(GOLDEN_BLOCK / 2, TEST_PID_MIX, 0.75);
+
+        const size_t at = (size_t)b * GOLDEN_BLOCK;
+        const float *in[2] = {s_input[0] + at, s_input[1] + at};
+        float *o[2] = {out[0] + at, out[1] + at};
+        // The sidechain is the input reversed, so its envelope doesn't just follow the main one
+        const float *sc[2] = {s_input[1] + (GOLDEN_FRAMES - at - GOLDEN_BLOCK),
+                              s_input[0] + (GOLDEN_FRAMES - at - GOLDEN_BLOCK)};
+        ok = test_process(plugin, in, o, nch, GOLDEN_BLOCK, c->sidechain ? sc : NULL) ==
+             CLAP_PROCESS_CONTINUE;
+    }
+    test_plugin_destroy(plugin);
+
+    // A mono variant leaves the right channel alone
+    if (nch == 1)
+        memset(out[1], 0, sizeof(out[1]));
+    return ok;
+}
+
+// Largest difference between two renders, or INFINITY if either isn't finite
+static double golden_error(const float a[2][GOLDEN_FRAMES], const float b[2][GOLDEN_FRAMES],
+                           uint32_t nch, uint32_t *at)
+{
+    double worst = 0.;
+    *at = 0;
+    for (uint32_t c = 0; c < nch; c++)
+        for (uint32_t i = 0; i < GOLDEN_FRAMES; i++)
+        {
+            double e = fabs((double)a[c][i] - b[c][i]);
+            if (!(e <= worst))
+            {
+                worst = isfinite(e) ? e : INFINITY;
+                *at = i;
+                if (worst == INFINITY)
+                    return worst;
+            }
+        }
+    return worst;
+}
+
+static bool golden_file(const char *dir, const char *name, float data[2][GOLDEN_FRAMES],
+                        bool write)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.f32", dir, name);
+    FILE *f = fopen(path, write ? "wb" : "rb");
+    if (!f)
+    {
+        fprintf(stderr, "%s: can't open %s\n", name, path);
+        return false;
+    }
+    const size_t count = 2 * GOLDEN_FRAMES;
+    const size_t done =
+        write ? fwrite(data, sizeof(float), count, f) : fread(data, sizeof(float), count, f);
+    fclose(f);
+    if (done != count)
+        fprintf(stderr, "%s: short %s on %s\n", name, write ? "write" : "read", path);
+    return done == count;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "usage: %s <plugin> <golden dir> <tolerance> [--update]\n", argv[0]);
+        return 2;
+    }
+    const char *dir = argv[2];
+    const double tolerance = atof(argv[3]);
+    const bool update = argc > 4 && !strcmp(argv[4], "--update");
+
+    {
+        const uint16_t probe = 1;
+        if (*(const uint8_t *)&probe != 1)
+        {
+            fprintf(stderr, "the golden files are little endian\n");
+            return 2;
+        }
+    }
+
+    if (!test_plugin_load(argv[1]))
+        return 1;
+    test_signal(s_input[0], s_input[1], GOLDEN_FRAMES);
+
+    // Every registry mode, then the other signal paths
+    const clap_plugin_t *plugin = test_plugin_create(0);
+    if (!plugin)
+    {
+        fprintf(stderr, "can't create the plugin\n");
+        return 1;
+    }
+    const clap_plugin_params_t *params = test_params(plugin);
+    clap_param_info_t mode_info;
+    const int32_t modes =
+        test_param_info(plugin, TEST_PID_MODE, &mode_info) ? (int32_t)mode_info.max_value + 1 : 0;
+
+    golden_case cases[64];
+    int32_t count = 0;
+    for (int32_t m = 0; m < modes && count < 60; m++)
+    {
+        char text[CLAP_NAME_SIZE];
+        golden_case *c = &cases[count++];
+        memset(c, 0, sizeof(*c));
+        c->mode = m;
+        if (!params->value_to_text(plugin, TEST_PID_MODE, m, text, sizeof(text)))
+            snprintf(text, sizeof(text), "mode %d", (int)m);
+        test_slug(c->name, sizeof(c->name), text);
+    }
+    test_plugin_destroy(plugin);
+
+    const golden_case extra[] = {
+        {"filters", 1, setup_filters, false, false},
+        {"bands", 0, setup_bands, false, false},
+        {"lookahead", 0, setup_lookahead, true, false},
+        {"sidechain", 3, setup_sidechain, false, true},
+    };
+    for (size_t k = 0; k < sizeof(extra) / sizeof(extra[0]); k++)
+        cases[count++] = extra[k];
+
+    static float renders[64][2][GOLDEN_FRAMES];
+    static float stored[2][GOLDEN_FRAMES];
+    int failures = 0;
+    for (int32_t k = 0; k < count; k++)
+    {
+        const golden_case *c = &cases[k];
+        if (!golden_render(0, c, renders[k]))
+        {
+            fprintf(stderr, "%s: render failed\n", c->name);
+            failures++;
+            continue;
+        }
+        if (update)
+        {
+            failures += !golden_file(dir, c->name, renders[k], true);
+            continue;
+        }
+        if (!golden_file(dir, c->name, stored, false))
+        {
+            fprintf(stderr, "%s: no golden render, build the golden_update target\n", c->name);
+            failures++;
+            continue;
+        }
+        uint32_t at;
+        const double err = golden_error(renders[k], stored, 2, &at);
+        printf("%-24s max error %.3g\n", c->name, err);
+        if (!(err <= tolerance))
+        {
+            fprintf(stderr, "%s: error %g at frame %u is over %g\n", c->name, err, at, tolerance);
+            failures++;
+        }
+    }
+
+    // A fixed variant is the full plugin locked to one mode, and has to sound like it
+    for (uint32_t v = 1; v < test_plugin_count(); v++)
+    {
+        const clap_plugin_descriptor_t *desc = test_plugin_descriptor(v);
+        plugin = test_plugin_create(v);
+        if (!plugin)
+        {
+            fprintf(stderr, "%s: can't create\n", desc->id);
+            failures++;
+            continue;
+        }
+        double mode;
+        test_params(plugin)->get_value(plugin, TEST_PID_MODE, &mode);
+        const uint32_t nch = test_plugin_channels(plugin);
+        test_plugin_destroy(plugin);
+
+        golden_case c = {{0}, (int32_t)mode, NULL, false, false};
+        static float variant[2][GOLDEN_FRAMES];
+        uint32_t at;
+        double err = INFINITY;
+        if (mode >= 0 && mode < modes && golden_render(v, &c, variant))
+            err = golden_error(variant, renders[(int32_t)mode], nch, &at);
+        printf("%-24s max error %.3g\n", desc->name, err);
+        if (!(err <= tolerance))
+        {
+            fprintf(stderr, "%s: differs from the full plugin by %g\n", desc->id, err);
+            failures++;
+        }
+    }
+
+    test_plugin_unload();
+    if (failures)
+        fprintf(stderr, "%d golden checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,603 @@
+#define _POSIX_C_SOURCE 200809L
+#include "host.h"
+
+#include <dlfcn.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static void *s_library;
+static const clap_plugin_entry_t *s_entry;
+static const clap_plugin_factory_t *s_factory;
+
+//////////
+// host //
+//////////
+
+// The tests run everything on one thread, so a requested main thread callback is delivered
+// straight after the process call that asked for it
+static bool s_callback_requested;
+
+// The plugin inside test_process, which is the only one that can ask for the thread pool
+static const clap_plugin_t *s_processing;
+
+static const clap_host_thread_pool_t s_host_thread_pool;
+static uint32_t s_workers;
+
+// What the plugin reported about the last preset it was asked to load: 1 loaded, -1 an error
+static int s_preset_report;
+
+static void test_host_preset_error(const clap_host_t *host, uint32_t location_kind,
+                                   const char *location, const char *load_key, int32_t os_error,
+                                   const char *msg)
+{
+    s_preset_report = -1;
+}
+static void test_host_preset_loaded(const clap_host_t *host, uint32_t location_kind,
+                                    const char *location, const char *load_key)
+{
+    s_preset_report = 1;
+}
+
+static const clap_host_preset_load_t s_host_preset_load = {
+    .on_error = test_host_preset_error,
+    .loaded = test_host_preset_loaded,
+};
+
+static const void *test_host_get_extension(const clap_host_t *host, const char *id)
+{
+    if (!strcmp(id, CLAP_EXT_THREAD_POOL) && s_workers)
+        return &s_host_thread_pool;
+    if (!strcmp(id, CLAP_EXT_PRESET_LOAD))
+        return &s_host_preset_load;
+    return NULL;
+}
+static void test_host_request_restart(const clap_host_t *host) {}
+static void test_host_request_process(const clap_host_t *host) {}
+static void test_host_request_callback(const clap_host_t *host) { s_callback_requested = true; }
+
+static const clap_host_t s_host = {
+    .clap_version = CLAP_VERSION_INIT,
+    .host_data = NULL,
+    .name = "clap-c99-distortion tests",
+    .vendor = "Surge Synth Team",
+    .url = "",
+    .version = "1.0.0",
+    .get_extension = test_host_get_extension,
+    .request_restart = test_host_request_restart,
+    .request_process = test_host_request_process,
+    .request_callback = test_host_request_callback,
+};
+
+///////////////
+// allocator //
+///////////////
+
+// Sanitizers bring their own allocator, which this must not replace
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) ||                         \
+    __has_feature(memory_sanitizer)
+#define TEST_SANITIZED 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define TEST_SANITIZED 1
+#endif
+
+// Set while the plugin runs on behalf of test_process, on the thread calling it and on pool
+// workers running its tasks
+static __thread bool s_counting;
+
+#if defined(__GLIBC__) && !defined(TEST_SANITIZED)
+#define TEST_COUNT_ALLOCS 1
+
+// glibc lets a program replace malloc and friends, and the plugin binds to the replacements as
+// well. These count every call and pass it on to glibc's own allocator.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+static uint64_t s_allocs, s_process_allocs;
+
+static void test_alloc_count(void)
+{
+    __atomic_fetch_add(&s_allocs, 1, __ATOMIC_RELAXED);
+    if (s_counting)
+        __atomic_fetch_add(&s_process_allocs, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+    test_alloc_count();
+    return __libc_malloc(size);
+}
+void *calloc(size_t count, size_t size)
+{
+    test_alloc_count();
+    return __libc_calloc(count, size);
+}
+void *realloc(void *p, size_t size)
+{
+    test_alloc_count();
+    return __libc_realloc(p, size);
+}
+void free(void *p)
+{
+    if (p)
+        test_alloc_count();
+    __libc_free(p);
+}
+#else
+#define TEST_COUNT_ALLOCS 0
+static uint64_t s_allocs, s_process_allocs;
+#endif
+
+bool test_alloc_counting(void) { return TEST_COUNT_ALLOCS; }
+uint64_t test_allocs(void) { return __atomic_load_n(&s_allocs, __ATOMIC_RELAXED); }
+uint64_t test_process_allocs(void) { return __atomic_load_n(&s_process_allocs, __ATOMIC_RELAXED); }
+
+////////////
+// plugin //
+////////////
+
+bool test_plugin_load(const char *path)
+{
+    s_library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!s_library)
+    {
+        fprintf(stderr, "can't load %s: %s\n", path, dlerror());
+        return false;
+    }
+    s_entry = (const clap_plugin_entry_t *)dlsym(s_library, "clap_entry");
+    if (!s_entry || !s_entry->init(path))
+    {
+        fprintf(stderr, "%s has no usable clap_entry\n", path);
+        dlclose(s_library);
+        s_library = NULL;
+        return false;
+    }
+    s_factory = s_entry->get_factory(CLAP_PLUGIN_FACTORY_ID);
+    if (!s_factory)
+    {
+        fprintf(stderr, "%s has no plugin factory\n", path);
+        test_plugin_unload();
+        return false;
+    }
+    return true;
+}
+
+void test_plugin_unload(void)
+{
+    if (!s_library)
+        return;
+    s_entry->deinit();
+    dlclose(s_library);
+    s_library = NULL;
+    s_entry = NULL;
+    s_factory = NULL;
+}
+
+uint32_t test_plugin_count(void) { return s_factory->get_plugin_count(s_factory); }
+
+const clap_plugin_descriptor_t *test_plugin_descriptor(uint32_t index)
+{
+    return s_factory->get_plugin_descriptor(s_factory, index);
+}
+
+const clap_plugin_t *test_plugin_create(uint32_t index)
+{
+    const clap_plugin_descriptor_t *desc = test_plugin_descriptor(index);
+    if (!desc)
+        return NULL;
+    const clap_plugin_t *plugin = s_factory->create_plugin(s_factory, &s_host, desc->id);
+    if (!plugin)
+        return NULL;
+    if (!plugin->init(plugin) || !plugin->activate(plugin, TEST_SAMPLE_RATE, 1, TEST_MAX_FRAMES) ||
+        !plugin->start_processing(plugin))
+    {
+        plugin->destroy(plugin);
+        return NULL;
+    }
+    return plugin;
+}
+
+void test_plugin_destroy(const clap_plugin_t *plugin)
+{
+    plugin->stop_processing(plugin);
+    plugin->deactivate(plugin);
+    plugin->destroy(plugin);
+}
+
+bool test_plugin_restart(const clap_plugin_t *plugin)
+{
+    plugin->stop_processing(plugin);
+    plugin->deactivate(plugin);
+    return plugin->activate(plugin, TEST_SAMPLE_RATE, 1, TEST_MAX_FRAMES) &&
+           plugin->start_processing(plugin);
+}
+
+uint32_t test_plugin_channels(const clap_plugin_t *plugin)
+{
+    const clap_plugin_audio_ports_t *ports = plugin->get_extension(plugin, CLAP_EXT_AUDIO_PORTS);
+    clap_audio_port_info_t info;
+    return ports && ports->get(plugin, 0, false, &info) ? info.channel_count : 0;
+}
+
+const clap_plugin_params_t *test_params(const clap_plugin_t *plugin)
+{
+    return plugin->get_extension(plugin, CLAP_EXT_PARAMS);
+}
+
+const clap_plugin_state_t *test_state(const clap_plugin_t *plugin)
+{
+    return plugin->get_extension(plugin, CLAP_EXT_STATE);
+}
+
+bool test_param_info(const clap_plugin_t *plugin, clap_id id, clap_param_info_t *info)
+{
+    const clap_plugin_params_t *params = test_params(plugin);
+    for (uint32_t i = 0; i < params->count(plugin); i++)
+        if (params->get_info(plugin, i, info) && info->id == id)
+            return true;
+    return false;
+}
+
+////////////
+// events //
+////////////
+
+static clap_event_param_value_t s_events[TEST_MAX_EVENTS];
+static uint32_t s_event_count;
+
+void test_param(uint32_t time, clap_id id, double value)
+{
+    if (s_event_count == TEST_MAX_EVENTS)
+    {
+        fprintf(stderr, "more than %d events in one block\n", TEST_MAX_EVENTS);
+        abort();
+    }
+    clap_event_param_value_t *ev = &s_events[s_event_count++];
+    memset(ev, 0, sizeof(*ev));
+    ev->header.size = sizeof(*ev);
+    ev->header.time = time;
+    ev->header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    ev->header.type = CLAP_EVENT_PARAM_VALUE;
+    ev->param_id = id;
+    ev->note_id = -1;
+    ev->port_index = -1;
+    ev->channel = -1;
+    ev->key = -1;
+    ev->value = value;
+}
+
+static uint32_t test_events_size(const clap_input_events_t *list) { return s_event_count; }
+
+static const clap_event_header_t *test_events_get(const clap_input_events_t *list,
+                                                  uint32_t index)
+{
+    return index < s_event_count ? &s_events[index].header : NULL;
+}
+
+static bool test_events_push(const clap_output_events_t *list, const clap_event_header_t *ev)
+{
+    return true;
+}
+
+static const clap_input_events_t s_in_events = {.size = test_events_size,
+                                                .get = test_events_get};
+static const clap_output_events_t s_out_events = {.try_push = test_events_push};
+
+void test_flush(const clap_plugin_t *plugin)
+{
+    test_params(plugin)->flush(plugin, &s_in_events, &s_out_events);
+    s_event_count = 0;
+}
+
+/////////////
+// process //
+/////////////
+
+clap_process_status test_process(const clap_plugin_t *plugin, const float *const *in,
+                                 float *const *out, uint32_t nch, uint32_t n,
+                                 const float *const *sidechain)
+{
+    static int64_t steady_time;
+
+    // data32 isn't const in the API, the plugin only reads inputs
+    clap_audio_buffer_t inputs[2] = {{.data32 = (float **)in, .channel_count = nch},
+                                     {.data32 = (float **)sidechain,
+                                      .channel_count = sidechain ? nch : 0}};
+    clap_audio_buffer_t output = {.data32 = (float **)out, .channel_count = nch};
+    clap_process_t process = {.steady_time = steady_time,
+                              .frames_count = n,
+                              .audio_inputs = inputs,
+                              .audio_outputs = &output,
+                              .audio_inputs_count = 2,
+                              .audio_outputs_count = 1,
+                              .in_events = &s_in_events,
+                              .out_events = &s_out_events};
+    s_processing = plugin;
+    s_counting = true;
+    clap_process_status status = plugin->process(plugin, &process);
+    s_counting = false;
+    s_processing = NULL;
+    steady_time += n;
+    s_event_count = 0;
+
+    if (s_callback_requested)
+    {
+        s_callback_requested = false;
+        plugin->on_main_thread(plugin);
+    }
+    return status;
+}
+
+/////////////////
+// thread pool //
+/////////////////
+
+// Workers sleep on wake until a request bumps the generation, then take task indices from next
+// along with the thread that made the request. That thread sleeps on done once the indices run
+// out and the last task to finish wakes it.
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    pthread_t threads[TEST_MAX_WORKERS];
+    const clap_plugin_t *plugin; // NULL runs empty tasks, for timing the handoff
+    const clap_plugin_thread_pool_t *exec;
+    uint32_t count, next, finished;
+    uint64_t generation;
+    bool quit;
+} test_thread_pool;
+
+static test_thread_pool s_pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                                  .wake = PTHREAD_COND_INITIALIZER,
+                                  .done = PTHREAD_COND_INITIALIZER};
+
+// Runs tasks until none are left, called and returning with the lock held
+static void test_pool_run_tasks(test_thread_pool *pool)
+{
+    while (pool->next < pool->count)
+    {
+        const uint32_t task = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (pool->plugin)
+        {
+            // Already set when test_process is the one helping out
+            const bool counting = s_counting;
+            s_counting = true;
+            pool->exec->exec(pool->plugin, task);
+            s_counting = counting;
+        }
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->count)
+            pthread_cond_signal(&pool->done);
+    }
+}
+
+static void *test_pool_worker(void *arg)
+{
+    test_thread_pool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    uint64_t seen = pool->generation;
+    while (!pool->quit)
+    {
+        if (pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            continue;
+        }
+        seen = pool->generation;
+        test_pool_run_tasks(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// help has the calling thread take tasks too, which the timing of the handoff leaves out
+static bool test_pool_exec(const clap_plugin_t *plugin, uint32_t num_tasks, bool help)
+{
+    test_thread_pool *pool = &s_pool;
+    pthread_mutex_lock(&pool->lock);
+    pool->plugin = plugin;
+    pool->exec = plugin ? plugin->get_extension(plugin, CLAP_EXT_THREAD_POOL) : NULL;
+    pool->count = num_tasks;
+    pool->next = pool->finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    if (help)
+        test_pool_run_tasks(pool);
+    while (pool->finished < pool->count)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+static bool test_host_request_exec(const clap_host_t *host, uint32_t num_tasks)
+{
+    return s_processing && s_workers && test_pool_exec(s_processing, num_tasks, true);
+}
+
+static const clap_host_thread_pool_t s_host_thread_pool = {.request_exec =
+                                                               test_host_request_exec};
+
+bool test_thread_pool_start(uint32_t workers)
+{
+    test_thread_pool_stop();
+    if (workers > TEST_MAX_WORKERS)
+        workers = TEST_MAX_WORKERS;
+    s_pool.quit = false;
+    for (; s_workers < workers; s_workers++)
+        if (pthread_create(&s_pool.threads[s_workers], NULL, test_pool_worker, &s_pool))
+        {
+            fprintf(stderr, "can't start thread pool worker %u\n", (unsigned)s_workers);
+            test_thread_pool_stop();
+            return false;
+        }
+    return true;
+}
+
+void test_thread_pool_stop(void)
+{
+    pthread_mutex_lock(&s_pool.lock);
+    s_pool.quit = true;
+    pthread_cond_broadcast(&s_pool.wake);
+    pthread_mutex_unlock(&s_pool.lock);
+    for (uint32_t w = 0; w < s_workers; w++)
+        pthread_join(s_pool.threads[w], NULL);
+    s_workers = 0;
+}
+
+double test_thread_pool_handoff(uint32_t num_tasks, uint32_t rounds)
+{
+    double best = INFINITY;
+    for (uint32_t r = 0; r < rounds && s_workers; r++)
+    {
+        const double t0 = test_seconds();
+        test_pool_exec(NULL, num_tasks, false);
+        const double t = test_seconds() - t0;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+///////////
+// state //
+///////////
+
+static int64_t test_stream_write(const clap_ostream_t *stream, const void *buffer, uint64_t size)
+{
+    test_stream *s = stream->ctx;
+    if (s->chunk && size > s->chunk)
+        size = s->chunk;
+    if (s->size + size > s->capacity)
+    {
+        size_t capacity = s->capacity ? s->capacity * 2 : 256;
+        while (capacity < s->size + size)
+            capacity *= 2;
+        char *data = realloc(s->data, capacity);
+        if (!data)
+            return -1;
+        s->data = data;
+        s->capacity = capacity;
+    }
+    memcpy(s->data + s->size, buffer, size);
+    s->size += size;
+    return (int64_t)size;
+}
+
+static int64_t test_stream_read(const clap_istream_t *stream, void *buffer, uint64_t size)
+{
+    test_stream *s = stream->ctx;
+    if (s->chunk && size > s->chunk)
+        size = s->chunk;
+    if (size > s->size - s->pos)
+        size = s->size - s->pos;
+    memcpy(buffer, s->data + s->pos, size);
+    s->pos += size;
+    return (int64_t)size;
+}
+
+bool test_state_save(const clap_plugin_t *plugin, test_stream *s)
+{
+    s->size = s->pos = 0;
+    clap_ostream_t stream = {.ctx = s, .write = test_stream_write};
+    return test_state(plugin)->save(plugin, &stream);
+}
+
+bool test_state_load(const clap_plugin_t *plugin, test_stream *s)
+{
+    s->pos = 0;
+    clap_istream_t stream = {.ctx = s, .read = test_stream_read};
+    return test_state(plugin)->load(plugin, &stream);
+}
+
+void test_stream_free(test_stream *s)
+{
+    free(s->data);
+    memset(s, 0, sizeof(*s));
+}
+
+////////////
+// preset //
+////////////
+
+bool test_preset_load(const clap_plugin_t *plugin, const char *path)
+{
+    const clap_plugin_preset_load_t *load = plugin->get_extension(plugin, CLAP_EXT_PRESET_LOAD);
+    if (!load)
+        return false;
+    s_preset_report = 0;
+    const bool loaded =
+        load->from_location(plugin, CLAP_PRESET_DISCOVERY_LOCATION_FILE, path, NULL);
+    if (s_preset_report != (loaded ? 1 : -1))
+    {
+        fprintf(stderr, "%s: the plugin didn't report the outcome to the host\n", path);
+        return false;
+    }
+    return loaded;
+}
+
+////////////
+// signal //
+////////////
+
+void test_signal(float *left, float *right, uint32_t n)
+{
+    // Exponential sweep from 20 Hz to 20 kHz
+    const double f0 = 20.0, f1 = 20000.0, k = log(f1 / f0);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const double t = (double)i / n;
+        const double phase = 2 * M_PI * f0 * n / TEST_SAMPLE_RATE * (exp(k * t) - 1) / k;
+        left[i] = (float)(0.9 * sin(phase));
+    }
+
+    // A noise burst every 512 frames, decaying by 60 dB over each one
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        const float noise = (float)(seed >> 8) / (float)(1u << 23) - 1.f;
+        right[i] = noise * (float)pow(10.0, -3.0 * (i % 512) / 512.0);
+    }
+}
+
+void test_slug(char *dst, size_t size, const char *name)
+{
+    size_t n = 0;
+    bool dash = false;
+    for (; *name && n + 2 < size; name++)
+    {
+        char ch = *name;
+        if (ch >= 'A' && ch <= 'Z')
+            ch = ch - 'A' + 'a';
+        if ((ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9'))
+        {
+            if (dash && n)
+                dst[n++] = '-';
+            dst[n++] = ch;
+            dash = false;
+        }
+        else
+            dash = true;
+    }
+    dst[n] = 0;
+}
+
+double test_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
@@ -0,0 +1,116 @@
+#pragma once
+// A minimal CLAP host for the tests.
+// The built plugin is loaded through clap_entry the way a host loads it, so the tests cover the
+// binary that ships rather than a copy of the sources compiled differently. Only what the tests
+// need is here: one plugin file at a time, parameter events, an in memory state stream, preset
+// files, a process call over planar float buffers, an optional thread pool and a count of heap
+// calls.
+#include <clap/clap.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Parameter ids, these are saved in sessions and never change
+enum
+{
+    TEST_PID_DRIVE = 2112,
+    TEST_PID_MIX = 8675309,
+    TEST_PID_MODE = 5150,
+    TEST_PID_LOW_CUT = 1812,
+    TEST_PID_EMPHASIS = 1984,
+    TEST_PID_HIGH_CUT = 2001,
+    TEST_PID_DC_BLOCK = 1066,
+    TEST_PID_OUTPUT = 1215,
+    TEST_PID_AUTO_GAIN = 1969,
+    TEST_PID_BANDS = 4000,
+    TEST_PID_CROSSOVER = 4001,
+    TEST_PID_BAND_MODE = 4100,
+    TEST_PID_BAND_DRIVE = 4200,
+    TEST_PID_BAND_MIX = 4300,
+    TEST_PID_LOOKAHEAD = 4400,
+    TEST_PID_SIDECHAIN = 4500
+};
+
+#define TEST_SAMPLE_RATE 48000.0
+#define TEST_MAX_FRAMES 4096
+#define TEST_MAX_EVENTS 256
+#define TEST_MAX_WORKERS 16
+
+// Loads the plugin file and initialises its entry. false, with a message on stderr, if it can't.
+bool test_plugin_load(const char *path);
+void test_plugin_unload(void);
+
+uint32_t test_plugin_count(void);
+const clap_plugin_descriptor_t *test_plugin_descriptor(uint32_t index);
+
+// Creates, initialises and activates plugin index at TEST_SAMPLE_RATE, NULL on failure
+const clap_plugin_t *test_plugin_create(uint32_t index);
+void test_plugin_destroy(const clap_plugin_t *plugin);
+
+// Deactivates and activates again, which is how a host answers request_restart
+bool test_plugin_restart(const clap_plugin_t *plugin);
+
+// Channels on the main ports
+uint32_t test_plugin_channels(const clap_plugin_t *plugin);
+
+const clap_plugin_params_t *test_params(const clap_plugin_t *plugin);
+const clap_plugin_state_t *test_state(const clap_plugin_t *plugin);
+
+// Looks a parameter up by id, false if the plugin doesn't have it
+bool test_param_info(const clap_plugin_t *plugin, clap_id id, clap_param_info_t *info);
+
+// Events for the next test_process call, which clears them. Times must not decrease.
+void test_param(uint32_t time, clap_id id, double value);
+
+// Hands the queued events to params flush instead of a process call, and clears them
+void test_flush(const clap_plugin_t *plugin);
+
+// Runs one block of n frames over nch channels. sidechain may be NULL for an unconnected port.
+clap_process_status test_process(const clap_plugin_t *plugin, const float *const *in,
+                                 float *const *out, uint32_t nch, uint32_t n,
+                                 const float *const *sidechain);
+
+// Offers the thread pool extension with workers threads besides the one calling test_process, to
+// plugins created after this, which is when they look for it. false if a thread can't be started.
+bool test_thread_pool_start(uint32_t workers);
+// Joins the workers and takes the extension away from plugins created after this
+void test_thread_pool_stop(void);
+// Fastest of rounds requests for num_tasks tasks that do nothing and that only the workers take,
+// in seconds. This is the least a request costs once any worker picks up a task: waking it and
+// being woken back. INFINITY with no pool running.
+double test_thread_pool_handoff(uint32_t num_tasks, uint32_t rounds);
+
+// Heap calls (malloc, calloc, realloc and free) the host has seen, by anyone and by the plugin
+// while it processes: inside test_process and in thread pool tasks. The host can only see them
+// when test_alloc_counting is true, with glibc and without a sanitizer, and both stay 0 otherwise.
+bool test_alloc_counting(void);
+uint64_t test_allocs(void);
+uint64_t test_process_allocs(void);
+
+// Growable byte buffer that serves as both the output and the input stream for state
+typedef struct
+{
+    char *data;
+    size_t size, capacity, pos;
+    size_t chunk; // most bytes moved per read or write call, 0 for no limit
+} test_stream;
+
+bool test_state_save(const clap_plugin_t *plugin, test_stream *s);
+bool test_state_load(const clap_plugin_t *plugin, test_stream *s);
+void test_stream_free(test_stream *s);
+
+// Loads a preset file through the preset load extension. false if the plugin refuses it or
+// doesn't tell the host how loading went.
+bool test_preset_load(const clap_plugin_t *plugin, const char *path);
+
+// Deterministic test signal: a sine sweep on the left and decaying noise bursts on the right,
+// both peaking near full scale so every shaper is driven into its nonlinear region
+void test_signal(float *left, float *right, uint32_t n);
+
+// Lower case with every run of other characters turned into one dash, so a display name like
+// "Soft Clip (Tanh)" can name a file or a benchmark case: "soft-clip-tanh"
+void test_slug(char *dst, size_t size, const char *name);
+
+// Monotonic clock for the benchmarks
+double test_seconds(void);
@@ -0,0 +1,174 @@
+// Parameter text test.
+// Every parameter is formatted at points across its range, parsed back and formatted again. The
+// second text has to be the first, and the parsed value has to land within 1% of the range of the
+// original. A table of hand written texts covers units, case, spacing and input that has to be
+// refused, and formatting into a buffer that is too small must fail without writing past it.
+//
+// usage: c99dist_params <plugin>
+#include "host.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PARAMS_POINTS 64
+
+static int s_failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do                                                                                             \
+    {                                                                                              \
+        if (!(cond))                                                                               \
+        {                                                                                          \
+            fprintf(stderr, __VA_ARGS__);                                                          \
+            fputc('\n', stderr);                                                                   \
+            s_failures++;                                                                          \
+        }                                                                                          \
+    } while (0)
+
+static void params_round_trip(const clap_plugin_t *plugin, const clap_param_info_t *info,
+                              double value)
+{
+    const clap_plugin_params_t *params = test_params(plugin);
+    char text[CLAP_NAME_SIZE], again[CLAP_NAME_SIZE];
+    double parsed = NAN;
+    if (!params->value_to_text(plugin, info->id, value, text, sizeof(text)))
+    {
+        CHECK(false, "%s: %g has no text", info->name, value);
+        return;
+    }
+    if (!params->text_to_value(plugin, info->id, text, &parsed))
+    {
+        CHECK(false, "%s: \"%s\" doesn't parse", info->name, text);
+        return;
+    }
+    CHECK(params->value_to_text(plugin, info->id, parsed, again, sizeof(again)) &&
+              !strcmp(text, again),
+          "%s: %g shows as \"%s\", which parses to %g, which shows as \"%s\"", info->name, value,
+          text, parsed, again);
+    CHECK(fabs(parsed - value) <= 0.01 * (info->max_value - info->min_value),
+          "%s: %g shows as \"%s\", which parses to %g", info->name, value, text, parsed);
+}
+
+typedef struct
+{
+    clap_id id;
+    const char *text;
+    bool ok;
+    double value;
+} params_parse_case;
+
+static const params_parse_case s_parse_cases[] = {
+    {TEST_PID_DRIVE, "0 dB", true, 0.},
+    {TEST_PID_DRIVE, " 6.02 db ", true, 0.99986},
+    {TEST_PID_DRIVE, "+6.02", true, 0.99986},
+    {TEST_PID_DRIVE, "-inf dB", true, -1.},
+    {TEST_PID_DRIVE, "-INF", true, -1.},
+    {TEST_PID_DRIVE, "6 Hz", false, 0.},
+    {TEST_PID_MIX, "50 %", true, 0.5},
+    {TEST_PID_MIX, "50%", true, 0.5},
+    {TEST_PID_MIX, "12.5", true, 0.125},
+    {TEST_PID_MODE, "soft clip (tanh)", true, 1.},
+    {TEST_PID_MODE, "  Bit Crush ", true, 6.},
+    {TEST_PID_MODE, "3", true, 3.},
+    {TEST_PID_MODE, "Soft", false, 0.},
+    {TEST_PID_LOW_CUT, "off", true, 20.},
+    {TEST_PID_LOW_CUT, "1.5 kHz", true, 1500.},
+    {TEST_PID_LOW_CUT, "200hz", true, 200.},
+    {TEST_PID_HIGH_CUT, "Off", true, 20000.},
+    {TEST_PID_OUTPUT, "-3.5 dB", true, -3.5},
+    {TEST_PID_DC_BLOCK, "on", true, 1.},
+    {TEST_PID_DC_BLOCK, "OFF", true, 0.},
+    {TEST_PID_BANDS, "Off", true, 1.},
+    {TEST_PID_BANDS, "3 Bands", true, 3.},
+    {TEST_PID_CROSSOVER + 1, "2.2 kHz", true, 2200.},
+    {TEST_PID_BAND_MIX + 2, "75 %", true, 0.75},
+    {TEST_PID_SIDECHAIN, "-2.5", true, -2.5},
+    {TEST_PID_DRIVE, "", false, 0.},
+    {TEST_PID_DRIVE, "dB", false, 0.},
+    {TEST_PID_MIX, "abc", false, 0.},
+    {TEST_PID_MIX, "1.2.3", false, 0.},
+    {TEST_PID_OUTPUT, "12 parsecs", false, 0.},
+    {TEST_PID_LOW_CUT, "-", false, 0.},
+    {TEST_PID_OUTPUT, "-inf dB", true, -24.},
+    {TEST_PID_OUTPUT, "-Inf", true, -24.},
+    {TEST_PID_OUTPUT, "inf dB", false, 0.},
+    {TEST_PID_DRIVE, "inf dB", false, 0.},
+    {TEST_PID_DRIVE, "+inf", false, 0.},
+    {TEST_PID_EMPHASIS, "-inf dB", false, 0.},
+    {TEST_PID_MIX, "inf %", false, 0.},
+    {TEST_PID_SIDECHAIN, "-inf", false, 0.},
+    {TEST_PID_LOW_CUT, "inf Hz", false, 0.},
+    {TEST_PID_CROSSOVER, "-inf", false, 0.},
+    {TEST_PID_BAND_MIX + 1, "inf", false, 0.},
+};
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <plugin>\n", argv[0]);
+        return 2;
+    }
+    if (!test_plugin_load(argv[1]))
+        return 1;
+    const clap_plugin_t *plugin = test_plugin_create(0);
+    if (!plugin)
+    {
+        fprintf(stderr, "can't create the plugin\n");
+        return 1;
+    }
+    const clap_plugin_params_t *params = test_params(plugin);
+
+    // Evenly spaced points, plus two just inside the ends where display cut offs tend to be
+    uint32_t checked = 0;
+    for (uint32_t i = 0; i < params->count(plugin); i++)
+    {
+        clap_param_info_t info;
+        params->get_info(plugin, i, &info);
+        const double range = info.max_value - info.min_value;
+        for (int p = 0; p < PARAMS_POINTS + 2; p++)
+        {
+            double v = p < PARAMS_POINTS ? info.min_value + range * p / (PARAMS_POINTS - 1)
+                       : p == PARAMS_POINTS ? info.min_value + 1e-3 * range
+                                            : info.max_value - 1e-3 * range;
+            if (info.flags & CLAP_PARAM_IS_STEPPED)
+                v = floor(v + 0.5);
+            params_round_trip(plugin, &info, v);
+            checked++;
+        }
+    }
+
+    for (size_t k = 0; k < sizeof(s_parse_cases) / sizeof(s_parse_cases[0]); k++)
+    {
+        const params_parse_case *c = &s_parse_cases[k];
+        double v = NAN;
+        const bool ok = params->text_to_value(plugin, c->id, c->text, &v);
+        CHECK(ok == c->ok, "\"%s\" for %u should %sparse", c->text, (unsigned)c->id,
+              c->ok ? "" : "not ");
+        if (ok && c->ok)
+            CHECK(fabs(v - c->value) < 1e-4, "\"%s\" for %u parses to %g, expected %g", c->text,
+                  (unsigned)c->id, v, c->value);
+    }
+
+    // Too small a buffer fails and leaves what follows it alone
+    {
+        char buffer[8];
+        memset(buffer, '#', sizeof(buffer));
+        CHECK(!params->value_to_text(plugin, TEST_PID_DRIVE, 1., buffer, 4) &&
+                  !memcmp(buffer + 4, "####", 4),
+              "drive text overflows a 4 byte buffer");
+        memset(buffer, '#', sizeof(buffer));
+        CHECK(!params->value_to_text(plugin, TEST_PID_MODE, 1., buffer, 4) &&
+                  !memcmp(buffer + 4, "####", 4),
+              "mode text overflows a 4 byte buffer");
+    }
+
+    test_plugin_destroy(plugin);
+    test_plugin_unload();
+    printf("%u values round tripped, %zu texts parsed\n", (unsigned)checked,
+           sizeof(s_parse_cases) / sizeof(s_parse_cases[0]));
+    if (s_failures)
+        fprintf(stderr, "%d parameter text checks failed\n", s_failures);
+    return s_failures ? 1 : 0;
+}
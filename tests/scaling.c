@@ -0,0 +1,172 @@
+// Thread pool scaling benchmark.
+// Times four bands of multiband shaping at block sizes from 32 to 1024 frames with the host
+// offering no thread pool and pools of 1, 2 and 4 workers, and reports nanoseconds per block. The
+// plugin only hands a block to the pool when it has THREAD_POOL_MIN_FRAMES frames or more, so
+// shorter blocks should time the same with or without one. To show where that threshold belongs
+// it also measures what one band costs per frame and what a request to the pool costs with tasks
+// that do nothing, and works out the block size where running the bands side by side starts to
+// pay for the handoff. Output with a pool has to match the serial output sample for sample, which
+// is the only thing that fails the test: timings depend on the machine, and on one core a pool
+// can only ever cost time.
+//
+// usage: c99dist_scaling <plugin>
+#define _POSIX_C_SOURCE 200809L
+#include "host.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCALING_FRAMES 8192
+#define SCALING_BANDS 4
+#define SCALING_ROUNDS 7
+#define SCALING_MIN_TIME 0.005 // seconds of passes per size and round
+#define SCALING_HANDOFFS 2000
+
+static const uint32_t s_blocks[] = {32, 64, 128, 256, 512, 1024};
+static const uint32_t s_workers[] = {0, 1, 2, 4};
+#define SCALING_NUM_BLOCKS (sizeof(s_blocks) / sizeof(s_blocks[0]))
+#define SCALING_NUM_WORKERS (sizeof(s_workers) / sizeof(s_workers[0]))
+
+static float s_input[2][SCALING_FRAMES];
+static float s_output[2][SCALING_FRAMES];
+static float s_serial[SCALING_NUM_BLOCKS][2][SCALING_FRAMES];
+
+static const clap_plugin_t *scaling_plugin(int32_t bands)
+{
+    const clap_plugin_t *plugin = test_plugin_create(0);
+    if (!plugin)
+        return NULL;
+    test_param(0, TEST_PID_DRIVE, 2.);
+    test_param(0, TEST_PID_BANDS, bands);
+    for (int32_t b = 0; b < bands; b++)
+        test_param(0, TEST_PID_BAND_MODE + b, (b * 3 + 1) % 7);
+    test_flush(plugin);
+    return plugin;
+}
+
+// One pass over the signal, seconds
+static double scaling_pass(const clap_plugin_t *plugin, uint32_t block)
+{
+    plugin->reset(plugin);
+    const double t0 = test_seconds();
+    for (uint32_t at = 0; at < SCALING_FRAMES; at += block)
+    {
+        const float *in[2] = {s_input[0] + at, s_input[1] + at};
+        float *out[2] = {s_output[0] + at, s_output[1] + at};
+        test_process(plugin, in, out, 2, block, NULL);
+    }
+    return test_seconds() - t0;
+}
+
+// Fastest pass at each block size, ns per block
+static void scaling_measure(const clap_plugin_t *plugin, double *ns)
+{
+    for (size_t k = 0; k < SCALING_NUM_BLOCKS; k++)
+        ns[k] = INFINITY;
+    for (int r = 0; r < SCALING_ROUNDS; r++)
+        for (size_t k = 0; k < SCALING_NUM_BLOCKS; k++)
+        {
+            const double start = test_seconds();
+            do
+            {
+                const double t = scaling_pass(plugin, s_blocks[k]) * 1e9 * s_blocks[k] /
+                                 SCALING_FRAMES;
+                if (t < ns[k])
+                    ns[k] = t;
+            } while (test_seconds() - start < SCALING_MIN_TIME);
+        }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <plugin>\n", argv[0]);
+        return 2;
+    }
+    if (!test_plugin_load(argv[1]))
+        return 1;
+    test_signal(s_input[0], s_input[1], SCALING_FRAMES);
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int failures = 0;
+
+    double ns[SCALING_NUM_WORKERS][SCALING_NUM_BLOCKS];
+    double handoff[SCALING_NUM_WORKERS] = {0};
+    for (size_t w = 0; w < SCALING_NUM_WORKERS; w++)
+    {
+        if (s_workers[w] && !test_thread_pool_start(s_workers[w]))
+            return 1;
+        const clap_plugin_t *plugin = scaling_plugin(SCALING_BANDS);
+        if (!plugin)
+        {
+            fprintf(stderr, "can't create the plugin\n");
+            return 1;
+        }
+        for (size_t k = 0; k < SCALING_NUM_BLOCKS; k++)
+        {
+            scaling_pass(plugin, s_blocks[k]);
+            if (!s_workers[w])
+                memcpy(s_serial[k], s_output, sizeof(s_output));
+            else if (memcmp(s_serial[k], s_output, sizeof(s_output)))
+            {
+                fprintf(stderr, "%u workers, %u frame blocks: output differs from serial\n",
+                        (unsigned)s_workers[w], (unsigned)s_blocks[k]);
+                failures++;
+            }
+        }
+        scaling_measure(plugin, ns[w]);
+        handoff[w] = test_thread_pool_handoff(SCALING_BANDS, SCALING_HANDOFFS) * 1e9;
+        test_plugin_destroy(plugin);
+        test_thread_pool_stop();
+    }
+
+    printf("%d bands, ns per block (x serial)\n%-8s", SCALING_BANDS, "frames");
+    for (size_t w = 0; w < SCALING_NUM_WORKERS; w++)
+        printf(" %9u workers", (unsigned)s_workers[w]);
+    printf("\n");
+    for (size_t k = 0; k < SCALING_NUM_BLOCKS; k++)
+    {
+        printf("%-8u", (unsigned)s_blocks[k]);
+        for (size_t w = 0; w < SCALING_NUM_WORKERS; w++)
+            printf(" %9.0f (%.2f)", ns[w][k], ns[w][k] / ns[0][k]);
+        printf("\n");
+    }
+
+    // What shaping one band costs, from the difference the band count makes in serial
+    double band_ns = 0.;
+    {
+        const uint32_t n = s_blocks[SCALING_NUM_BLOCKS - 1];
+        double t[2];
+        for (int b = 0; b < 2; b++)
+        {
+            const clap_plugin_t *plugin = scaling_plugin(b ? SCALING_BANDS : SCALING_BANDS / 2);
+            double all[SCALING_NUM_BLOCKS];
+            scaling_measure(plugin, all);
+            t[b] = all[SCALING_NUM_BLOCKS - 1];
+            test_plugin_destroy(plugin);
+        }
+        band_ns = (t[1] - t[0]) / (SCALING_BANDS - SCALING_BANDS / 2) / n;
+    }
+    printf("one band costs %.2f ns per frame, %ld cores online\n", band_ns, cores);
+
+    // With k threads sharing the bands the block waits for ceil(bands / k) of them instead of
+    // all of them, and the pool pays off once that saving covers the handoff
+    for (size_t w = 1; w < SCALING_NUM_WORKERS; w++)
+    {
+        const uint32_t on_cores = cores > 1 ? (uint32_t)cores : 2;
+        uint32_t k = s_workers[w] + 1;
+        k = k < on_cores ? k : on_cores;
+        k = k < SCALING_BANDS ? k : SCALING_BANDS;
+        const uint32_t saved = SCALING_BANDS - (SCALING_BANDS + k - 1) / k;
+        printf("%u workers: a request costs %.0f ns, break even at %.0f frames on %u cores%s\n",
+               (unsigned)s_workers[w], handoff[w], handoff[w] / (saved * band_ns), on_cores,
+               cores > 1 ? "" : " (estimated, this machine has one)");
+    }
+
+    test_plugin_unload();
+    if (failures)
+        fprintf(stderr, "%d thread pool checks failed\n", failures);
+    return failures ? 1 : 0;
+}
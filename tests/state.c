@@ -0,0 +1,281 @@
+// State save and load test.
+// Moves every parameter off its default, saves, and loads the chunk into a fresh instance through
+// a stream that only passes a few bytes per call. The copy has to report the same values, save
+// the same bytes and render the same output. Truncated chunks must be refused, a version 1 chunk
+// from before the later fields existed must still load, values out of range must be clamped as
+// they load, and a curve stored in the chunk has to reach the Curve shapers. The same curve loaded
+// from a preset file has to give the same chunk, and files without a curve must be refused.
+//
+// usage: c99dist_state <plugin>
+#define _POSIX_C_SOURCE 200809L
+#include "host.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STATE_FRAMES 1024
+#define STATE_BLOCK 256
+
+static float s_input[2][STATE_FRAMES];
+static int s_failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do                                                                                             \
+    {                                                                                              \
+        if (!(cond))                                                                               \
+        {                                                                                          \
+            fprintf(stderr, __VA_ARGS__);                                                          \
+            fputc('\n', stderr);                                                                   \
+            s_failures++;                                                                          \
+        }                                                                                          \
+    } while (0)
+
+static void state_render(const clap_plugin_t *plugin, float out[2][STATE_FRAMES])
+{
+    plugin->reset(plugin);
+    for (uint32_t at = 0; at < STATE_FRAMES; at += STATE_BLOCK)
+    {
+        const float *in[2] = {s_input[0] + at, s_input[1] + at};
+        float *o[2] = {out[0] + at, out[1] + at};
+        test_process(plugin, in, o, 2, STATE_BLOCK, in);
+    }
+}
+
+// One silent block, which is where the audio thread picks up loaded settings
+static void state_settle(const clap_plugin_t *plugin)
+{
+    static const float silence[2][STATE_BLOCK];
+    static float out[2][STATE_BLOCK];
+    const float *in[2] = {silence[0], silence[1]};
+    float *o[2] = {out[0], out[1]};
+    test_process(plugin, in, o, 2, STATE_BLOCK, NULL);
+}
+
+static bool state_same_render(const clap_plugin_t *a, const clap_plugin_t *b)
+{
+    static float ra[2][STATE_FRAMES], rb[2][STATE_FRAMES];
+    state_render(a, ra);
+    state_render(b, rb);
+    return !memcmp(ra, rb, sizeof(ra));
+}
+
+// Every parameter of a against b
+static void state_compare_values(const clap_plugin_t *a, const clap_plugin_t *b, const char *what)
+{
+    const clap_plugin_params_t *params = test_params(a);
+    for (uint32_t i = 0; i < params->count(a); i++)
+    {
+        clap_param_info_t info;
+        double va = NAN, vb = NAN;
+        params->get_info(a, i, &info);
+        params->get_value(a, info.id, &va);
+        params->get_value(b, info.id, &vb);
+        CHECK(va == vb, "%s: %s is %g, expected %g", what, info.name, vb, va);
+    }
+}
+
+static double state_value(const clap_plugin_t *plugin, clap_id id)
+{
+    double v = NAN;
+    test_params(plugin)->get_value(plugin, id, &v);
+    return v;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <plugin>\n", argv[0]);
+        return 2;
+    }
+    if (!test_plugin_load(argv[1]))
+        return 1;
+    test_signal(s_input[0], s_input[1], STATE_FRAMES);
+
+    // Every parameter 70% of the way up its range, rounded where it is stepped
+    const clap_plugin_t *a = test_plugin_create(0);
+    const clap_plugin_params_t *params = test_params(a);
+    for (uint32_t i = 0; i < params->count(a); i++)
+    {
+        clap_param_info_t info;
+        params->get_info(a, i, &info);
+        double v = info.min_value + 0.7 * (info.max_value - info.min_value);
+        if (info.flags & CLAP_PARAM_IS_STEPPED)
+            v = floor(v + 0.5);
+        test_param(0, info.id, v);
+    }
+    state_settle(a);
+    // The lookahead only switches on at activation
+    CHECK(test_plugin_restart(a), "restart failed");
+
+    test_stream saved = {0};
+    CHECK(test_state_save(a, &saved), "save failed");
+
+    // Load through a stream that moves three bytes at a time
+    const clap_plugin_t *b = test_plugin_create(0);
+    test_stream chunked = saved;
+    chunked.chunk = 3;
+    CHECK(test_state_load(b, &chunked), "load failed");
+    CHECK(test_plugin_restart(b), "restart failed");
+    state_settle(b);
+    state_compare_values(a, b, "loaded");
+
+    test_stream resaved = {0};
+    resaved.chunk = 5;
+    CHECK(test_state_save(b, &resaved) && resaved.size == saved.size &&
+              !memcmp(resaved.data, saved.data, saved.size),
+          "saving a loaded state gives different bytes");
+    test_stream_free(&resaved);
+    CHECK(state_same_render(a, b), "a loaded state renders differently");
+
+    // Every truncation of the chunk has to be refused
+    const clap_plugin_t *c = test_plugin_create(0);
+    for (size_t len = 0; len < saved.size; len++)
+    {
+        test_stream cut = saved;
+        cut.size = len;
+        CHECK(!test_state_load(c, &cut), "a chunk cut to %zu of %zu bytes loaded", len,
+              saved.size);
+    }
+    test_plugin_destroy(c);
+
+    // Version 1 held drive, mix and mode. Everything after that keeps the old sound.
+    {
+        const clap_plugin_t *old = test_plugin_create(0);
+        const int32_t version = 1, mode = 2;
+        const float drive = 2.f, mix = 0.25f;
+        test_stream v1 = {0};
+        v1.data = malloc(16);
+        v1.size = v1.capacity = 16;
+        memcpy(v1.data, &version, 4);
+        memcpy(v1.data + 4, &drive, 4);
+        memcpy(v1.data + 8, &mix, 4);
+        memcpy(v1.data + 12, &mode, 4);
+        CHECK(test_state_load(old, &v1), "version 1 chunk refused");
+        state_settle(old);
+        CHECK(state_value(old, TEST_PID_DRIVE) == drive, "version 1 drive");
+        CHECK(state_value(old, TEST_PID_MIX) == mix, "version 1 mix");
+        CHECK(state_value(old, TEST_PID_MODE) == mode, "version 1 mode");
+        CHECK(state_value(old, TEST_PID_DC_BLOCK) == 0., "version 1 has no DC blocker");
+        CHECK(state_value(old, TEST_PID_BANDS) == 1., "version 1 has one band");
+        CHECK(state_value(old, TEST_PID_LOOKAHEAD) == 0., "version 1 has no lookahead");
+        test_stream_free(&v1);
+        test_plugin_destroy(old);
+    }
+
+    // Values out of range are pulled into it before anything reaches the audio thread, and
+    // read back that way before it has run. Versions from the future are refused.
+    {
+        const clap_plugin_t *bad = test_plugin_create(0);
+        clap_param_info_t mode_info, drive_info;
+        test_param_info(bad, TEST_PID_MODE, &mode_info);
+        test_param_info(bad, TEST_PID_DRIVE, &drive_info);
+        int32_t version = 1;
+        const int32_t mode = 1000;
+        const float drive = NAN, mix = 4.f;
+        test_stream v1 = {0};
+        v1.data = malloc(16);
+        v1.size = v1.capacity = 16;
+        memcpy(v1.data, &version, 4);
+        memcpy(v1.data + 4, &drive, 4);
+        memcpy(v1.data + 8, &mix, 4);
+        memcpy(v1.data + 12, &mode, 4);
+        CHECK(test_state_load(bad, &v1), "out of range chunk refused");
+        CHECK(state_value(bad, TEST_PID_MODE) == mode_info.max_value, "mode isn't clamped");
+        CHECK(state_value(bad, TEST_PID_DRIVE) == drive_info.min_value, "NaN drive is kept");
+        CHECK(state_value(bad, TEST_PID_MIX) == 1., "mix isn't clamped");
+        state_settle(bad);
+        CHECK(state_value(bad, TEST_PID_MODE) == mode_info.max_value, "mode isn't clamped");
+
+        version = 1000;
+        memcpy(v1.data, &version, 4);
+        CHECK(!test_state_load(bad, &v1), "a chunk from a later version loaded");
+        test_stream_free(&v1);
+        test_plugin_destroy(bad);
+    }
+
+    // A chunk with its own curve, which b then saves unchanged. The default curve has no
+    // points, so the loaded one is spliced in after the header.
+    {
+        static const float points[3][2] = {{-1.f, -0.3f}, {0.2f, 0.1f}, {1.f, 0.9f}};
+        const uint32_t num_points = 3, old_points = *(const uint32_t *)(saved.data + 16);
+        const size_t tail = 20 + old_points * sizeof(points[0]);
+
+        test_stream curved = {0};
+        curved.size = curved.capacity = 20 + sizeof(points) + (saved.size - tail);
+        curved.data = malloc(curved.size);
+        memcpy(curved.data, saved.data, 16);
+        memcpy(curved.data + 16, &num_points, 4);
+        memcpy(curved.data + 20, points, sizeof(points));
+        memcpy(curved.data + 20 + sizeof(points), saved.data + tail, saved.size - tail);
+
+        CHECK(test_state_load(b, &curved), "curve chunk refused");
+        test_stream copy = {0};
+        CHECK(test_state_save(b, &copy) && copy.size == curved.size &&
+                  !memcmp(copy.data, curved.data, curved.size),
+              "a loaded curve doesn't save back unchanged");
+        test_stream_free(&copy);
+
+        // Only the curve differs between a and b, so only the Curve modes can tell them apart.
+        for (int32_t mode = 0;; mode++)
+        {
+            char name[CLAP_NAME_SIZE];
+            if (!params->value_to_text(a, TEST_PID_MODE, mode, name, sizeof(name)))
+                break;
+            const bool curve = !strncmp(name, "Curve", 5);
+            const clap_plugin_t *both[2] = {a, b};
+            for (int k = 0; k < 2; k++)
+            {
+                // Multiband shapes with the band modes, which would hide the main one
+                test_param(0, TEST_PID_BANDS, 1.);
+                test_param(0, TEST_PID_MODE, mode);
+                test_flush(both[k]);
+            }
+            CHECK(state_same_render(a, b) != curve, "%s: the loaded curve %s", name,
+                  curve ? "is not used" : "changes a shaper that has no curve");
+        }
+
+        // The same points as a preset file, loaded into a, leave nothing to tell a and b apart
+        char path[] = "/tmp/c99dist-curve-XXXXXX";
+        const int fd = mkstemp(path);
+        FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+        CHECK(f, "can't write a curve file");
+        if (f)
+        {
+            fprintf(f, "# x y\n\n");
+            for (uint32_t i = 0; i < num_points; i++)
+                fprintf(f, "%.9g %.9g\n", points[i][0], points[i][1]);
+            fclose(f);
+            CHECK(test_preset_load(a, path), "curve file refused");
+            test_stream sa = {0}, sb = {0};
+            CHECK(test_state_save(a, &sa) && test_state_save(b, &sb) && sa.size == sb.size &&
+                      !memcmp(sa.data, sb.data, sa.size),
+                  "a curve file doesn't save like the same curve in a chunk");
+            test_stream_free(&sa);
+            test_stream_free(&sb);
+            CHECK(state_same_render(a, b), "the curve file isn't used");
+
+            f = fopen(path, "w");
+            if (f)
+            {
+                fprintf(f, "# no points\n");
+                fclose(f);
+                CHECK(!test_preset_load(a, path), "a file without points loaded");
+            }
+            remove(path);
+        }
+        CHECK(!test_preset_load(a, path), "a missing file loaded");
+        test_stream_free(&curved);
+    }
+
+    test_stream_free(&saved);
+    test_plugin_destroy(a);
+    test_plugin_destroy(b);
+    test_plugin_unload();
+    if (s_failures)
+        fprintf(stderr, "%d state checks failed\n", s_failures);
+    return s_failures ? 1 : 0;
+}
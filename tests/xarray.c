@@ -0,0 +1,262 @@
+// xarray microbenchmark.
+// Times the array.h macros against the heap only versions they replaced, kept below as
+// oldarr_*: pushing into an empty array, pushing after xarr_reserve, pushing into an xarena
+// array, and emptying an array from random positions with the ordered delete and with
+// xarr_swap_remove. Every push has to build the same array, both deletes have to remove every
+// element once and an array outgrowing its arena has to carry on from the heap, which are the
+// only things that fail the test. The timings are for reading, allocator speed varies too much
+// between systems to hold them to a baseline.
+//
+// usage: c99dist_xarray
+#define _POSIX_C_SOURCE 200809L
+#include "array.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define XARRAY_ELEMENTS 1000
+#define XARRAY_ROUNDS 7
+#define XARRAY_MIN_TIME 0.02 // seconds of passes per case and round
+
+// array.h before the arena, with its prefix changed so both can be used side by side
+// clang-format off
+struct oldarray_header
+{
+    size_t length;
+    size_t capacity;
+};
+#define oldarr_header(a)      ((struct oldarray_header*)(a)-1)
+#define oldarr_len(a)         ((a) ? oldarr_header(a)->length : 0)
+#define oldarr_cap(a)         ((a) ? oldarr_header(a)->capacity : 0)
+#define oldarr_free(a)        ((void)((a) ? XARR_FREE(oldarr_header(a)) : (void)0), (a) = NULL)
+static void* __oldarr_setcap(struct oldarray_header* next_ptr, size_t next_cap, void* ptr) {
+    if (!ptr) next_ptr->length = 0;
+    next_ptr->capacity = next_cap;
+    return (void*)(next_ptr+1);
+}
+#define oldarr_setcap(a, N)   (oldarr_cap(a) < (N) \
+                              ? (void)((a) = __oldarr_setcap((struct oldarray_header*)XARR_REALLOC(((a) ? (void*)oldarr_header(a) : (void*)a), sizeof(*a)*(N<(oldarr_cap(a)*2)?(oldarr_cap(a)*2):N)+sizeof(struct oldarray_header)), (N<(oldarr_cap(a)*2)?(oldarr_cap(a)*2):N), (a)))\
+                              : (void)0)
+#define oldarr_push(a, v)     (oldarr_setcap(a, oldarr_len(a) + 1), (a)[oldarr_header(a)->length++] = (v))
+#define oldarr_deleten(a, i, N) (memmove(&(a)[i], &(a)[(i) + (N)], sizeof *(a) * (oldarr_header(a)->length - (N) - (i))), oldarr_header(a)->length -= (N))
+#define oldarr_delete(a, i)   oldarr_deleten(a, (i), 1)
+// clang-format on
+
+typedef struct
+{
+    const char *name;
+    uint64_t (*run)(void); // one pass, returns a checksum of what the array held
+    const char *against;   // the case it replaces, NULL for the old ones
+} xarray_case;
+
+static struct xarena s_arena;
+// Room for every block a doubling array leaves behind on its way to XARRAY_ELEMENTS
+static char s_arena_memory[4 * XARRAY_ELEMENTS * sizeof(uint32_t) + 4096];
+static uint32_t s_order[XARRAY_ELEMENTS]; // positions to delete from, in turn
+
+static uint64_t xarray_sum(const uint32_t *a, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum = sum * 31 + a[i];
+    return sum;
+}
+
+static uint64_t run_old_push(void)
+{
+    uint32_t *a = NULL;
+    for (uint32_t i = 0; i < XARRAY_ELEMENTS; i++)
+        oldarr_push(a, i);
+    const uint64_t sum = xarray_sum(a, oldarr_len(a));
+    oldarr_free(a);
+    return sum;
+}
+
+static uint64_t run_push(void)
+{
+    uint32_t *a = NULL;
+    for (uint32_t i = 0; i < XARRAY_ELEMENTS; i++)
+        xarr_push(a, i);
+    const uint64_t sum = xarray_sum(a, xarr_len(a));
+    xarr_free(a);
+    return sum;
+}
+
+static uint64_t run_reserve_push(void)
+{
+    uint32_t *a = NULL;
+    xarr_reserve(a, XARRAY_ELEMENTS);
+    for (uint32_t i = 0; i < XARRAY_ELEMENTS; i++)
+        xarr_push(a, i);
+    const uint64_t sum = xarray_sum(a, xarr_len(a));
+    xarr_free(a);
+    return sum;
+}
+
+// Starts small so the arena has to grow it the way the heap does
+static uint64_t run_arena_push(void)
+{
+    uint32_t *a = NULL;
+    xarena_reset(&s_arena);
+    xarr_arena_init(a, &s_arena, 16);
+    for (uint32_t i = 0; i < XARRAY_ELEMENTS; i++)
+        xarr_push(a, i);
+    const uint64_t sum = xarray_sum(a, xarr_len(a));
+    xarr_free(a);
+    return sum;
+}
+
+// Empties the array from pseudo random positions, the way a timer list drops its entries, and
+// returns the sum of what was removed
+static uint64_t run_old_delete(void)
+{
+    uint32_t *a = NULL;
+    oldarr_setcap(a, XARRAY_ELEMENTS);
+    for (uint32_t i = 0; i < XARRAY_ELEMENTS; i++)
+        a[i] = i;
+    oldarr_header(a)->length = XARRAY_ELEMENTS;
+    uint64_t sum = 0;
+    for (uint32_t k = 0; k < XARRAY_ELEMENTS; k++)
+    {
+        const size_t i = s_order[k] % oldarr_len(a);
+        sum += a[i];
+        oldarr_delete(a, i);
+    }
+    oldarr_free(a);
+    return sum;
+}
+
+static uint64_t run_swap_remove(void)
+{
+    uint32_t *a = NULL;
+    xarr_reserve(a, XARRAY_ELEMENTS);
+    for (uint32_t i = 0; i < XARRAY_ELEMENTS; i++)
+        a[i] = i;
+    xarr_header(a)->length = XARRAY_ELEMENTS;
+    uint64_t sum = 0;
+    for (uint32_t k = 0; k < XARRAY_ELEMENTS; k++)
+    {
+        const size_t i = s_order[k] % xarr_len(a);
+        sum += a[i];
+        xarr_swap_remove(a, i);
+    }
+    xarr_free(a);
+    return sum;
+}
+
+// Pushes past the end of an arena with room for a few blocks, and returns whether the array went
+// to the heap with every element
+static bool xarray_outgrows_arena(void)
+{
+    static char memory[1024];
+    struct xarena arena;
+    xarena_init(&arena, memory, sizeof(memory));
+    uint32_t *a = NULL;
+    xarr_arena_init(a, &arena, 16);
+    for (uint32_t i = 0; i < XARRAY_ELEMENTS; i++)
+        xarr_push(a, i);
+    bool ok = xarr_len(a) == XARRAY_ELEMENTS && !xarr_header(a)->arena;
+    for (uint32_t i = 0; ok && i < XARRAY_ELEMENTS; i++)
+        ok = a[i] == i;
+    xarr_free(a);
+
+    // Full from the start
+    xarena_init(&arena, memory, 0);
+    xarr_arena_init(a, &arena, 16);
+    xarr_push(a, 7u);
+    ok = ok && xarr_len(a) == 1 && a[0] == 7 && !xarr_header(a)->arena;
+    xarr_free(a);
+    return ok;
+}
+
+static double xarray_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+int main(void)
+{
+    static const xarray_case cases[] = {
+        {"push, old", run_old_push, NULL},
+        {"push", run_push, "push, old"},
+        {"push after reserve", run_reserve_push, "push, old"},
+        {"push into arena", run_arena_push, "push, old"},
+        {"delete, old", run_old_delete, NULL},
+        {"swap remove", run_swap_remove, "delete, old"},
+    };
+    enum
+    {
+        count = sizeof(cases) / sizeof(cases[0])
+    };
+
+    xarena_init(&s_arena, s_arena_memory, sizeof(s_arena_memory));
+    uint32_t seed = 1;
+    for (uint32_t k = 0; k < XARRAY_ELEMENTS; k++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        s_order[k] = seed >> 8;
+    }
+
+    // Removal order differs between the two deletes, so only the sum of what was removed has
+    // to agree, which holds because both remove every element once
+    int failures = 0;
+    uint64_t sums[count];
+    for (int k = 0; k < count; k++)
+        sums[k] = cases[k].run();
+    const uint64_t removed = (uint64_t)XARRAY_ELEMENTS * (XARRAY_ELEMENTS - 1) / 2;
+    for (int k = 0; k < count; k++)
+    {
+        const bool deleting = cases[k].run == run_old_delete || cases[k].run == run_swap_remove;
+        if (deleting ? sums[k] != removed : sums[k] != sums[0])
+        {
+            fprintf(stderr, "%s: the array holds the wrong elements\n", cases[k].name);
+            failures++;
+        }
+    }
+    if (!xarray_outgrows_arena())
+    {
+        fprintf(stderr, "an array outgrowing its arena lost elements\n");
+        failures++;
+    }
+
+    // Rounds go over every case in turn, so a busy spell doesn't land on one case only
+    double ns[count];
+    for (int k = 0; k < count; k++)
+        ns[k] = INFINITY;
+    volatile uint64_t sink = 0;
+    for (int r = 0; r < XARRAY_ROUNDS; r++)
+        for (int k = 0; k < count; k++)
+        {
+            const double start = xarray_seconds();
+            double now = start;
+            do
+            {
+                const double t0 = now;
+                sink += cases[k].run();
+                now = xarray_seconds();
+                const double t = (now - t0) * 1e9 / XARRAY_ELEMENTS;
+                if (t < ns[k])
+                    ns[k] = t;
+            } while (now - start < XARRAY_MIN_TIME);
+        }
+
+    printf("%d elements, ns per element\n", XARRAY_ELEMENTS);
+    for (int k = 0; k < count; k++)
+    {
+        printf("%-20s %8.2f", cases[k].name, ns[k]);
+        for (int j = 0; j < count && cases[k].against; j++)
+            if (!strcmp(cases[j].name, cases[k].against))
+                printf("  %5.2fx %s", ns[k] / ns[j], cases[j].name);
+        printf("\n");
+    }
+    (void)sink;
+    if (failures)
+        fprintf(stderr, "%d xarray checks failed\n", failures);
+    return failures ? 1 : 0;
+}